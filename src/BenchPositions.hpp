@@ -0,0 +1,46 @@
+/**
+ * This file is part of Karen11.
+ *
+ * Karen11 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Karen11 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Karen11.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+namespace karen11
+{
+
+struct BenchPosition
+{
+	/* "opening", "middlegame" or "endgame" */
+	const char* phase;
+	const char* fen;
+};
+
+/* Positions searched by `karen bench` and `karen scaling` and used by karen_bench.
+ * Changing them changes signature of `karen bench`. */
+inline constexpr BenchPosition benchPositions[] = {
+	{ "opening", "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1" },
+	{ "opening", "r1bqkbnr/pppp1ppp/2n5/4p3/4P3/5N2/PPPP1PPP/RNBQKB1R w KQkq - 2 3" },
+	{ "opening", "rnbqkb1r/pp2pppp/3p1n2/8/3NP3/8/PPP2PPP/RNBQKB1R w KQkq - 1 5" },
+	{ "middlegame", "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1" },
+	{ "middlegame", "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10" },
+	{ "middlegame", "r1bq1rk1/pp2bppp/2n1pn2/3p4/2PP4/2N1PN2/PP1B1PPP/R2QKB1R b KQ - 3 8" },
+	{ "middlegame", "2rq1rk1/pb1nbppp/1p2pn2/2pp4/2PP4/1PN1PN2/PB2BPPP/2RQ1RK1 w - - 2 11" },
+	{ "middlegame", "r1b2rk1/2q1bppp/p2ppn2/1p6/3BPP2/2N2B2/PPPQ2PP/2KR3R b - - 2 13" },
+	{ "endgame", "6k1/pp3ppp/4p3/2P5/1P1r4/P3K3/5PPP/2R5 b - - 0 28" },
+	{ "endgame", "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1" },
+	{ "endgame", "8/5pk1/6p1/3R4/5P2/6PK/r7/8 b - - 0 40" },
+	{ "endgame", "8/8/4kpp1/3p1b2/p6P/2B5/6P1/6K1 b - - 0 47" },
+};
+
+} /* namespace karen11 */
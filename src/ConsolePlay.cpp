@@ -15,13 +15,17 @@
  * along with Karen11.  If not, see <https://www.gnu.org/licenses/>.
  */
 #include "ConsolePlay.hpp"
+#include "PerfCounters.hpp"
+#include "BenchPositions.hpp"
 
 #include <iostream>
 #include <fstream>
 #include <cstdio>
+#include <cstring>
 #include <tuple>
 #include <array>
 #include <algorithm>
+#include <thread>
 
 namespace karen11
 {
@@ -48,6 +52,14 @@ bool ConsolePlay::useUnicode = true;
 bool ConsolePlay::useUnicode = false;
 #endif
 
+byte ConsolePlay::depth = 0;
+Play::Clock ConsolePlay::timeControl;
+unsigned ConsolePlay::searchThreads = 1;
+unsigned ConsolePlay::hashSize = 16;
+bool ConsolePlay::pondering = true;
+std::shared_ptr<const Network> ConsolePlay::network;
+std::string ConsolePlay::traceFile;
+
 /* \033[0m - resets terminal mode(std::ostream manipulator) */
 static std::ostream& reset(std::ostream& out) noexcept
 {
@@ -122,10 +134,33 @@ namespace bg
 }
 
 ConsolePlay::ConsolePlay()
-	: Play(promptSide()) {}
+	: Play(promptSide())
+{
+	threads = searchThreads;
+	ponder = pondering;
+	setHashSize(hashSize);
+	if (network)
+		setNetwork(network);
+}
 
 ConsolePlay::~ConsolePlay() noexcept
 {
+	if (!traceFile.empty())
+	{
+		std::ofstream fout(traceFile);
+		try
+		{
+			engine().writeTrace(fout);
+		}
+		catch (const std::exception&)
+		{
+			fout.setstate(std::ios::failbit);
+		}
+		if (fout)
+			cout << fg::green << "Wrote trace of the game to '" << traceFile << "'.\n";
+		else
+			cout << fg::red << "Failed to write trace to '" << traceFile << "' :(\n";
+	}
 	cout << reset << std::endl;
 }
 
@@ -307,6 +342,14 @@ bool ConsolePlay::inputMove(Move& move)
 		{
 		    printHistory(std::cout);
 		}
+		else if (s == "hint")
+		{
+			printHint();
+		}
+		else if (s == "stats")
+		{
+			printStats(std::cout);
+		}
 		else if (s == "eval" || s == "evaluate")
 		{
 			Score score = engine().evaluate();
@@ -405,6 +448,27 @@ void ConsolePlay::draw()
 )";
 }
 
+void ConsolePlay::printHint()
+{
+	const Move none = makeMove(Square::A1, Square::A1);
+	const Move expected = expectedMove();
+	if (expected != none)
+	{
+		/* Karen is thinking on the move she expects, so answer is ready */
+		cout << fg::magenta << "I think you should play " << to_string(expected) << ".\n";
+		const Move answer = engine().bestMove();
+		if (answer != none && engine().completedDepth() > 0)
+			cout << fg::yellow << "Then I'd play " << to_string(answer)
+				 << "(I looked " << engine().completedDepth() << " moves ahead).\n";
+		return;
+	}
+	const Move move = engine().hashMove();
+	if (move != none)
+		cout << fg::magenta << "I think you should play " << to_string(move) << ".\n";
+	else
+		cout << fg::magenta << "I have no idea, just make a move.\n";
+}
+
 void ConsolePlay::fillMessageBuffer()
 {
 	if (moved)
@@ -425,7 +489,12 @@ void ConsolePlay::fillMessageBuffer()
 			" I moved "s + std::to_string(move) +
 			", it took "s + std::to_string(info.time.count()) + "ms for me."s +
 			" I transfered "s + std::to_string(info.positionsTransfered) +
-			" and evaluated "s + std::to_string(info.positionsEvaluated) + " positions."s;
+			" and evaluated "s + std::to_string(info.positionsEvaluated) + " positions, "s +
+			std::to_string(info.evalCacheHits) + " of them were cached."s;
+		if (depth == 0)
+			messageBuffer +=
+				" My clock: "s + std::to_string(clock(!playerSide).count() / 1000) +
+				"s, yours: "s + std::to_string(clock(playerSide).count() / 1000) + "s."s;
 	}
 	else
 	{
@@ -561,18 +630,457 @@ void ConsolePlay::printHistory(std::ostream& stream)
 	stream << fg::magenta << "End.\n";
 }
 
+/**
+ * @brief Print percentiles of `histogram` in one line of table, values are divided by `unit`.
+ */
+static void printPercentiles(std::ostream& stream, const char* name, const Histogram& histogram, double unit)
+{
+	char line[160];
+	std::snprintf(line, sizeof(line), "%-10s %11.1f %11.1f %11.1f %11.1f %11.1f %11.1f\n", name,
+				  histogram.percentile(50) / unit, histogram.percentile(90) / unit,
+				  histogram.percentile(99) / unit, histogram.percentile(99.9) / unit,
+				  histogram.max() / unit, histogram.mean() / unit);
+	stream << line;
+}
+
+static constexpr const char* percentilesHeader =
+	"                   p50         p90         p99       p99.9         max        mean\n";
+
+void ConsolePlay::printStats(std::ostream& stream)
+{
+	const auto stats = engine().searchStats();
+	const auto percent = [](uint64_t part, uint64_t whole) {
+		return std::to_string(whole ? part * 100 / whole : 0) + "%";
+	};
+	const uint64_t nodes = stats.pvNodes + stats.cutNodes + stats.allNodes;
+	stream << fg::magenta << "Search stats(" << (engine().isThinking() ? "search is running" : "last search") << "):\n"
+		   << fg::blue << "\tNodes searched:     " << fg::yellow << engine().nodesSearched() << '\n'
+		   << fg::blue << "\tPV/cut/all nodes:   " << fg::yellow << stats.pvNodes << '/' << stats.cutNodes << '/'
+		   << stats.allNodes << " (" << percent(stats.pvNodes, nodes) << '/' << percent(stats.cutNodes, nodes) << '/'
+		   << percent(stats.allNodes, nodes) << ")\n"
+		   << fg::blue << "\tQuiescence nodes:   " << fg::yellow << stats.quiescenceNodes << '\n'
+		   << fg::blue << "\tSelective depth:    " << fg::yellow << stats.selDepth << '\n'
+		   << fg::blue << "\tNull move cutoffs:  " << fg::yellow << stats.nullMoveCutoffs << " of "
+		   << stats.nullMoveTries << " tries (" << percent(stats.nullMoveCutoffs, stats.nullMoveTries) << ")\n"
+		   << fg::blue << "\tFirst move cutoffs: " << fg::yellow << stats.firstMoveCutoffs << " of "
+		   << stats.betaCutoffs << " beta cutoffs (" << percent(stats.firstMoveCutoffs, stats.betaCutoffs) << ")\n"
+		   << fg::blue << "\tHash table:         " << fg::yellow << stats.ttProbes << " probes, "
+		   << stats.ttHits << " hits (" << percent(stats.ttHits, stats.ttProbes) << "), "
+		   << stats.ttCutoffs << " cutoffs\n";
+	if (thinkTimeHistogram().count())
+	{
+		stream << fg::blue << "Karen's thinks this game:\n" << percentilesHeader;
+		printPercentiles(stream, "time ms", thinkTimeHistogram(), 1000);
+		printPercentiles(stream, "knodes", thinkNodeHistogram(), 1000);
+	}
+	stream << fg::magenta << "End.\n";
+}
+
+
+/**
+ * Result of searching one of `benchPositions`.
+ */
+struct BenchResult
+{
+	uint64_t nodes;
+	std::chrono::milliseconds time;
+	uint64_t ttWriteConflicts;
+	uint64_t lockWaits;
+	/* Positions evaluated statically */
+	uint64_t evaluated;
+};
+
+/**
+ * @brief Search every bench position to `depth` with new engine, so hash
+ * contents don't leak between positions.
+ * @param deterministic search with `Engine::Limits::deterministic`, which needs one thread.
+ * @param perf counts hardware events of all searches, it's reset here and
+ * enabled only while engines search, not while they're created or destroyed.
+ * @param verbose print result of every position.
+ */
+static std::vector<BenchResult> searchBenchPositions(unsigned depth, unsigned threads, unsigned hash,
+													 bool deterministic, PerfCounters& perf, bool verbose)
+{
+	std::vector<BenchResult> results;
+	perf.reset();
+	for (const auto& position : benchPositions)
+	{
+		Color side;
+		const Board board = parseFen(position.fen, side);
+		Engine engine(board, side);
+		engine.setHashSize(hash);
+		if (ConsolePlay::network)
+			engine.setNetwork(ConsolePlay::network);
+		Engine::Limits limits;
+		limits.depth = depth;
+		limits.threads = threads;
+		limits.deterministic = deterministic;
+
+		const auto start = std::chrono::steady_clock::now();
+		perf.enable();
+		engine.startThink(limits).get();
+		perf.disable();
+		const auto time = std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::steady_clock::now() - start);
+		const auto& info = engine.getState();
+		results.push_back({engine.nodesSearched(), time, info.ttWriteConflicts, info.lockWaits,
+						   info.positionsEvaluated});
+		if (verbose)
+			cout << "Position " << results.size() << '/' << std::size(benchPositions) << ": "
+				 << results.back().nodes << " nodes, " << time.count() << " ms\n";
+	}
+	return results;
+}
+
+/**
+ * @return sum of `results`.
+ */
+static BenchResult total(const std::vector<BenchResult>& results)
+{
+	BenchResult sum{0, std::chrono::milliseconds(0), 0, 0, 0};
+	for (const auto& result : results)
+	{
+		sum.nodes += result.nodes;
+		sum.evaluated += result.evaluated;
+		sum.time += result.time;
+		sum.ttWriteConflicts += result.ttWriteConflicts;
+		sum.lockWaits += result.lockWaits;
+	}
+	return sum;
+}
+
+/**
+ * @brief Print hardware events counted by `perf` per node and per evaluated position.
+ */
+static void printCounters(const PerfCounters& perf, const BenchResult& sum)
+{
+	if (!perf.available())
+	{
+		cout << "Hardware counters are not available: " << perf.error() << "\n";
+		return;
+	}
+	const auto values = perf.read();
+	cout << "Hardware counters            total      per node  per evaluation\n";
+	for (unsigned i = 0; i < PerfCounters::EVENT_COUNT; i++)
+	{
+		char line[96];
+		if (values[i] < 0)
+			std::snprintf(line, sizeof(line), "%-15s %14s\n", PerfCounters::names[i], "n/a");
+		else
+			std::snprintf(line, sizeof(line), "%-15s %14.0f %13.2f %15.2f\n", PerfCounters::names[i], values[i],
+						  values[i] / std::max<uint64_t>(sum.nodes, 1), values[i] / std::max<uint64_t>(sum.evaluated, 1));
+		cout << line;
+	}
+	if (values[PerfCounters::CYCLES] > 0 && values[PerfCounters::INSTRUCTIONS] >= 0)
+		cout << "Instructions per cycle: "
+			 << values[PerfCounters::INSTRUCTIONS] / values[PerfCounters::CYCLES] << "\n";
+}
+
+/**
+ * @return hardware events counted by `perf` as JSON object or null when they aren't available.
+ */
+static std::string countersJson(const PerfCounters& perf)
+{
+	if (!perf.available())
+		return "null";
+	const auto values = perf.read();
+	std::string json = "{";
+	for (unsigned i = 0; i < PerfCounters::EVENT_COUNT; i++)
+		json += (i ? ",\""s : "\""s) + PerfCounters::names[i] + "\":" +
+			(values[i] < 0 ? "null"s : std::to_string(uint64_t(values[i])));
+	return json + "}";
+}
 
 bool ConsolePlay::parseOptions(int argc, char** argv) noexcept
 {
 	for (int i = 1; i < argc; i++)
 	{
 		std::string option = argv[i];
+		if (option == "selfplay")
+		{
+			/* Arguments of command follow it: [games] [depth] [threads] */
+			unsigned values[] = { 10, 5, 1 };
+			const unsigned limits[] = { 100'000, Engine::max_ply, 256 };
+			for (int j = 0; j < 3 && i + 1 + j < argc; j++)
+				if (!parseNumber("="s + argv[i + 1 + j], values[j]) || values[j] == 0 || values[j] > limits[j])
+				{
+					std::cout << fg::red << "Usage: karen selfplay [games] [depth] [threads]\n" << reset;
+					return true;
+				}
+			try
+			{
+				selfPlay(values[0], values[1], values[2]);
+			}
+			catch (const std::exception& e)
+			{
+				std::cout << fg::red << e.what() << '\n' << reset;
+			}
+			return true;
+		}
+		if (option == "bench" || option == "scaling")
+		{
+			/* Arguments of command follow it: [depth] [threads] [hash] */
+			unsigned values[] = { 6, option == "bench" ? 1u : std::max(std::thread::hardware_concurrency(), 1u), 16 };
+			const unsigned limits[] = { Engine::max_ply, 256, 65536 };
+			for (int j = 0; j < 3 && i + 1 + j < argc; j++)
+				if (!parseNumber("="s + argv[i + 1 + j], values[j]) || values[j] == 0 || values[j] > limits[j])
+				{
+					std::cout << fg::red << "Usage: karen " << option << " [depth] [threads] [hash]\n" << reset;
+					return true;
+				}
+			try
+			{
+				if (option == "bench")
+					bench(values[0], values[1], values[2]);
+				else
+					scaling(values[0], values[1], values[2]);
+			}
+			catch (const std::exception& e)
+			{
+				std::cout << fg::red << e.what() << '\n' << reset;
+			}
+			return true;
+		}
 		if (parseOption(option))
 			return true;
 	}
 	return false;
 }
 
+void ConsolePlay::bench(unsigned depth, unsigned threads, unsigned hash)
+{
+	PerfCounters perf;
+	const auto results = searchBenchPositions(depth, threads, hash, threads == 1, perf, true);
+	const BenchResult sum = total(results);
+	const uint64_t nps = sum.nodes * 1000 / std::max<uint64_t>(sum.time.count(), 1);
+	cout << "\nDepth:           " << depth
+		 << "\nThreads:         " << threads
+		 << "\nHash:            " << hash << " MB"
+		 << "\nKernels:         " << kernels.name
+		 << "\nTotal time:      " << sum.time.count() << " ms"
+		 << "\nNodes searched:  " << sum.nodes
+		 << "\nNodes/second:    " << nps
+		 << "\nSignature:       " << sum.nodes << (threads == 1 ? "" : " (not reproducible with several threads)")
+		 << "\nEvaluations:     " << sum.evaluated
+		 << "\n\n";
+	printCounters(perf, sum);
+	cout << '\n';
+
+	cout << "{\"version\":\"" << Engine::version.major << '.' << Engine::version.minor
+		 << "\",\"kernels\":\"" << kernels.name
+		 << "\",\"depth\":" << depth << ",\"threads\":" << threads << ",\"hash\":" << hash
+		 << ",\"time_ms\":" << sum.time.count() << ",\"nodes\":" << sum.nodes << ",\"nps\":" << nps
+		 << ",\"signature\":" << sum.nodes << ",\"evaluated\":" << sum.evaluated
+		 << ",\"counters\":" << countersJson(perf) << ",\"positions\":[";
+	for (size_t i = 0; i < results.size(); i++)
+		cout << (i ? "," : "") << results[i].nodes;
+	cout << "]}\n";
+}
+
+void ConsolePlay::scaling(unsigned depth, unsigned maxThreads, unsigned hash)
+{
+	std::vector<unsigned> counts;
+	for (unsigned threads = 1; threads < maxThreads; threads *= 2)
+		counts.push_back(threads);
+	counts.push_back(maxThreads);
+
+	cout << "Depth " << depth << ", hash " << hash << " MB, " << kernels.name << " kernels.\n"
+		 << "Time-to-depth speedup is total time of one thread divided by total time, search\n"
+		 << "overhead is nodes searched more than with one thread. Contention is flagged when\n"
+		 << "transposition table write conflicts exceed 0.1% of nodes.\n\n"
+		 << "threads        nodes    time ms          nps  nps speedup  ttd speedup  overhead"
+		 << "  tt conflicts  lock waits\n";
+	std::string json = "{\"depth\":" + std::to_string(depth) + ",\"hash\":" + std::to_string(hash) +
+		",\"kernels\":\"" + kernels.name + "\",\"steps\":[";
+	BenchResult first{};
+	PerfCounters perf;
+	std::string counters;
+	for (unsigned threads : counts)
+	{
+		const BenchResult sum = total(searchBenchPositions(depth, threads, hash, false, perf, false));
+		if (threads == 1)
+			first = sum;
+		const double time = std::max<double>(sum.time.count(), 1);
+		const double nps = sum.nodes * 1000.0 / time;
+		const double npsSpeedup = nps / (first.nodes * 1000.0 / std::max<double>(first.time.count(), 1));
+		const double ttdSpeedup = std::max<double>(first.time.count(), 1) / time;
+		const double overhead = double(sum.nodes) / std::max<uint64_t>(first.nodes, 1) - 1;
+		const bool contention = sum.ttWriteConflicts * 1000 > sum.nodes;
+
+		char line[160];
+		std::snprintf(line, sizeof(line), "%7u %12llu %10lld %12.0f %12.2f %12.2f %8.1f%% %13llu %11llu%s\n",
+					  threads, static_cast<unsigned long long>(sum.nodes), static_cast<long long>(sum.time.count()),
+					  nps, npsSpeedup, ttdSpeedup, overhead * 100, static_cast<unsigned long long>(sum.ttWriteConflicts),
+					  static_cast<unsigned long long>(sum.lockWaits),
+					  contention ? "  contention" : "");
+		cout << line << std::flush;
+		std::snprintf(line, sizeof(line), "%s{\"threads\":%u,\"nodes\":%llu,\"time_ms\":%lld,\"nps\":%.0f,"
+					  "\"nps_speedup\":%.3f,\"ttd_speedup\":%.3f,\"overhead\":%.4f,",
+					  threads == 1 ? "" : ",", threads, static_cast<unsigned long long>(sum.nodes),
+					  static_cast<long long>(sum.time.count()), nps, npsSpeedup, ttdSpeedup, overhead);
+		json += line;
+		json += "\"tt_write_conflicts\":" + std::to_string(sum.ttWriteConflicts) +
+			",\"lock_waits\":" + std::to_string(sum.lockWaits) +
+			",\"contention\":" + (contention ? "true" : "false") +
+			",\"evaluated\":" + std::to_string(sum.evaluated) +
+			",\"counters\":" + countersJson(perf) + "}";
+
+		/* Events per node show where time of extra threads goes */
+		if (perf.available())
+		{
+			const auto values = perf.read();
+			std::snprintf(line, sizeof(line), "%7u", threads);
+			counters += line;
+			for (double value : values)
+			{
+				if (value < 0)
+					std::snprintf(line, sizeof(line), "%14s", "n/a");
+				else
+					std::snprintf(line, sizeof(line), "%14.2f", value / std::max<uint64_t>(sum.nodes, 1));
+				counters += line;
+			}
+			counters += '\n';
+		}
+	}
+	cout << '\n';
+	if (perf.available())
+	{
+		cout << "Hardware events per node:\nthreads";
+		for (const char* name : PerfCounters::names)
+			cout << std::string(14 - std::strlen(name), ' ') << name;
+		cout << '\n' << counters << '\n';
+	}
+	else cout << "Hardware counters are not available: " << perf.error() << "\n\n";
+	cout << json << "]}\n";
+}
+
+namespace
+{
+
+/**
+ * Game of Karen against another engine without user interface.
+ * Opponent plays random moves in the opening so games differ.
+ */
+class SelfPlay final : public Play
+{
+public:
+	SelfPlay(Color opponentSide, unsigned depth, unsigned threads, unsigned seed)
+		: Play(opponentSide), opponent(Board::standard(), Color::WHITE), depth(depth), random(seed)
+	{
+		this->threads = threads;
+		maxMoves = max_moves;
+		ponder = false;
+		opponent.setHashSize(ConsolePlay::hashSize);
+		setHashSize(ConsolePlay::hashSize);
+	}
+
+	using Play::history;
+
+	/* Games are stopped after that many moves */
+	static constexpr unsigned max_moves = 50;
+
+	/**
+	 * @return false if the last game was stopped after `maxMoves` moves.
+	 */
+	[[nodiscard]]
+	bool finished() const noexcept { return ended; }
+
+private:
+	bool renderBoard(Color) override { return false; }
+	void win() override { ended = true; }
+	void gameOver() override { ended = true; }
+	void draw() override { ended = true; }
+
+	bool inputMove(Move& move) override
+	{
+		if (history().size() < random_plies)
+		{
+			const auto moves = engine().availableMoves(true);
+			move = moves[random() % moves.size()];
+			return false;
+		}
+		opponent.setBoard(engine().getBoard(), playerSide);
+		Engine::Limits limits;
+		limits.depth = depth;
+		limits.threads = threads;
+		move = opponent.startThink(limits).get();
+		return false;
+	}
+
+	Engine opponent;
+	unsigned depth;
+	std::mt19937 random;
+	bool ended = false;
+	/* Number of half moves played randomly */
+	static constexpr unsigned random_plies = 4;
+};
+
+} /* namespace */
+
+/**
+ * @return percentiles of `histogram` as JSON object.
+ */
+static std::string percentilesJson(const Histogram& histogram)
+{
+	return "{\"count\":" + std::to_string(histogram.count()) +
+		",\"p50\":" + std::to_string(histogram.percentile(50)) +
+		",\"p90\":" + std::to_string(histogram.percentile(90)) +
+		",\"p99\":" + std::to_string(histogram.percentile(99)) +
+		",\"p99.9\":" + std::to_string(histogram.percentile(99.9)) +
+		",\"max\":" + std::to_string(histogram.max()) + "}";
+}
+
+void ConsolePlay::selfPlay(unsigned games, unsigned depth, unsigned threads)
+{
+	cout << "Karen plays " << games << " games to depth " << depth << " with " << threads
+		 << " threads against herself, opening moves of opponent are random.\n\n";
+	Histogram times, nodes;
+	Play::SlowestThink slowest;
+	unsigned slowestGame = 0;
+	std::vector<Move> slowestLine;
+	int score[3] = {};
+	unsigned unfinished = 0;
+	for (unsigned game = 1; game <= games; game++)
+	{
+		const Color opponentSide = (game % 2) ? Color::BLACK : Color::WHITE;
+		SelfPlay play(opponentSide, depth, threads, game);
+		const auto result = play(static_cast<byte>(std::min(depth, unsigned(Engine::max_ply))));
+		const int karenResult = (result == Play::Result::DRAW || result == Play::Result::NONE) ? 0 :
+			((result == Play::Result::WHITE_WON) == (opponentSide == Color::BLACK) ? 1 : -1);
+		if (play.finished())
+			score[karenResult + 1]++;
+		else
+			unfinished++;
+		times += play.thinkTimeHistogram();
+		nodes += play.thinkNodeHistogram();
+		if (play.slowestThink().time > slowest.time)
+		{
+			slowest = play.slowestThink();
+			slowestGame = game;
+			slowestLine.assign(play.history().begin(), play.history().begin() + slowest.halfMove - 1);
+		}
+		const Histogram& gameTimes = play.thinkTimeHistogram();
+		char line[160];
+		std::snprintf(line, sizeof(line), "Game %u: %s, %zu half moves, think p50 %.1f ms, p99 %.1f ms, max %.1f ms\n",
+					  game, !play.finished() ? "unfinished" : karenResult > 0 ? "won" : karenResult < 0 ? "lost" : "draw",
+					  play.history().size(),
+					  gameTimes.percentile(50) / 1000.0, gameTimes.percentile(99) / 1000.0, gameTimes.max() / 1000.0);
+		cout << line << std::flush;
+	}
+
+	cout << "\nKaren as white and black: +" << score[2] << " =" << score[1] << " -" << score[0]
+		 << ", " << unfinished << " unfinished after " << SelfPlay::max_moves << " moves, "
+		 << times.count() << " thinks.\n\n" << percentilesHeader;
+	printPercentiles(cout, "time ms", times, 1000);
+	printPercentiles(cout, "knodes", nodes, 1000);
+	cout << "\nSlowest think: " << slowest.time.count() / 1000.0 << " ms, " << slowest.nodes << " nodes, half move "
+		 << slowest.halfMove << " of game " << slowestGame << " after moves:";
+	for (Move move : slowestLine)
+		cout << ' ' << to_string(move);
+	cout << "\n\n{\"games\":" << games << ",\"depth\":" << depth << ",\"threads\":" << threads
+		 << ",\"think_time_us\":" << percentilesJson(times) << ",\"think_nodes\":" << percentilesJson(nodes) << "}\n";
+}
+
 bool ConsolePlay::parseOption(const std::string& s) noexcept
 {
 	if (s == "--version")
@@ -603,15 +1111,92 @@ bool ConsolePlay::parseOption(const std::string& s) noexcept
 		else clearScreen = true;
 		return false;
 	}
+	unsigned value;
+	if (s.find("--depth=") == 0 && parseNumber(s, value) && value > 0 && value <= Engine::max_ply)
+	{
+		depth = value;
+		return false;
+	}
+	if (s.find("--time=") == 0 && parseNumber(s, value) && value > 0)
+	{
+		timeControl.base = std::chrono::minutes(value);
+		return false;
+	}
+	if (s.find("--increment=") == 0 && parseNumber(s, value))
+	{
+		timeControl.increment = std::chrono::seconds(value);
+		return false;
+	}
+	if (s.find("--movestogo=") == 0 && parseNumber(s, value))
+	{
+		timeControl.movesToGo = value;
+		return false;
+	}
+	if (s.find("--threads=") == 0 && parseNumber(s, value) && value > 0)
+	{
+		searchThreads = value;
+		return false;
+	}
+	if (s.find("--hash=") == 0 && parseNumber(s, value) && value > 0)
+	{
+		hashSize = value;
+		return false;
+	}
+	if (s.find("--nnue=") == 0 && s.size() > 7)
+	{
+		try
+		{
+			network = Network::load(s.substr(7));
+		}
+		catch (const std::exception& e)
+		{
+			std::cout << fg::red << e.what() << '\n' << reset;
+			return true;
+		}
+		return false;
+	}
+	if (s.find("--trace=") == 0 && s.size() > 8)
+	{
+		if (instrumentation < Instrumentation::TRACING)
+		{
+			std::cout << fg::red << "Karen was built without tracing, configure with -DKAREN_INSTRUMENTATION=TRACING.\n"
+					  << reset;
+			return true;
+		}
+		traceFile = s.substr(8);
+		return false;
+	}
+	if (s.find("--ponder") != s.npos)
+	{
+		if (s.find("OFF") != s.npos) pondering = false;
+		else pondering = true;
+		return false;
+	}
 	std::cout << fg::red << "Unrecognized option '" << s << "'.\n" << reset;
     return true;
 }
 
+bool ConsolePlay::parseNumber(const std::string& s, unsigned& value) noexcept
+{
+	const auto pos = s.find('=');
+	if (pos == s.npos || pos + 1 == s.size())
+		return false;
+	value = 0;
+	for (auto it = s.begin() + pos + 1; it != s.end(); ++it)
+	{
+		if (*it < '0' || *it > '9' || value > 100'000)
+			return false;
+		value = value * 10 + (*it - '0');
+	}
+	return true;
+}
+
 void ConsolePlay::printVersion() noexcept
 {
 	std::cout << "Karen version is "
 			  << Engine::version.major << '.' << Engine::version.minor
 			  << ". Built in " << __DATE__ << ".\n"
+			  << "Using " << kernels.name << " kernels.\n"
 			  << R"(
 Copyright (C) 2021  Adil Mokhammad
 
@@ -642,6 +1227,33 @@ options:
     --color={ON|OFF}         Enables colored output via ANSII escape sequences.
     --clearscreen={ON|OFF}   Enables clearing terminal after every move.
     --unicode={ON|OFF}       Enables unicode symbols output.
+    --time=<minutes>         Time on the clock of each side(default is 5).
+    --increment=<seconds>    Time added to the clock after every move(default is 0).
+    --movestogo=<moves>      Number of moves the time on the clock is given for,
+                             0 means whole game(default is 0).
+    --depth=<depth>          Makes Karen search every move to fixed depth instead of
+                             playing with clock.
+    --threads=<threads>      Number of threads Karen thinks with(default is 1).
+    --hash=<megabytes>       Size of Karen's hash table(default is 16).
+    --ponder={ON|OFF}        Enables Karen thinking while you are thinking.
+    --nnue=<file>            Makes Karen evaluate positions with neural network
+                             loaded from file.
+    --trace=<file>           Writes timeline of Karen's searches to file when game ends,
+                             open it in Perfetto or chrome://tracing. Requires Karen built
+                             with -DKAREN_INSTRUMENTATION=TRACING.
+
+bench [depth] [threads] [hash]
+                             Searches fixed positions to depth(default is 6) with threads
+                             (default is 1) and hash size in megabytes(default is 16), prints
+                             nodes, time, speed and node count signature, the last line is JSON.
+scaling [depth] [threads] [hash]
+                             Searches positions of bench with 1, 2, 4, ... threads(default is
+                             number of cores) and prints speed, time-to-depth speedup, search
+                             overhead and contention on shared tables, the last line is JSON.
+selfplay [games] [depth] [threads]
+                             Plays games(default is 10) of Karen against herself searching to
+                             depth(default is 5) and prints percentiles of think time and nodes
+                             and the slowest think, the last line is JSON.
 
 commands(type them when Karen asks you to input move):
     version                  Prints karen's version.
@@ -650,6 +1262,9 @@ commands(type them when Karen asks you to input move):
     clearscreen              Toggles clearing terminal after every move.
     unicode                  Toggles unicode symbols output.
     history                  Prints move history.
+    hint                     Prints move Karen would play instead of you.
+    stats                    Prints node types, cutoffs and hash table hits of Karen's
+                             current or last search and percentiles of her think times.
     save                     Writes move history to file 'karen-history.txt'.
     <move>                   Makes a move. If you want to do quiet move or capture simply type
                              source and destination squares, for example D2D4 or g8:f6.
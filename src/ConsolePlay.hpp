@@ -31,6 +31,17 @@ public:
 	static bool colored;
 	static bool clearScreen;
 	static bool useUnicode;
+	/* Depth karen searches to, zero means karen plays with clock */
+	static byte depth;
+	static Clock timeControl;
+	static unsigned searchThreads;
+	/* Size of transposition table in megabytes */
+	static unsigned hashSize;
+	static bool pondering;
+	/* Network loaded with --nnue option, nullptr means hand-written evaluation */
+	static std::shared_ptr<const Network> network;
+	/* File trace of the game is written to when game ends, set with --trace option */
+	static std::string traceFile;
 
 	ConsolePlay();
 	~ConsolePlay() noexcept;
@@ -47,11 +58,32 @@ public:
 	 * Print version to stdout.
 	 */
 	static void printVersion() noexcept;
+	/**
+	 * Search embedded positions to `depth` and print nodes, time, speed and
+	 * node count signature to stdout, the last line is the same report in JSON.
+	 * Signature depends only on search behaviour when `threads` is 1.
+	 */
+	static void bench(unsigned depth, unsigned threads, unsigned hash);
+	/**
+	 * Search positions of `bench()` with 1, 2, 4, ... `maxThreads` threads and print
+	 * speedup of nodes per second and of time to depth, search overhead and
+	 * contention on shared state for every number of threads.
+	 */
+	static void scaling(unsigned depth, unsigned maxThreads, unsigned hash);
+	/**
+	 * Play `games` games of karen against herself without user interface and print
+	 * percentiles of her think times and nodes, and the slowest think over all games.
+	 */
+	static void selfPlay(unsigned games, unsigned depth, unsigned threads);
 	static bool parseOptions(int argc, char** argv) noexcept;
 	/**
 	 * Print move history to `stream`.
 	 */
 	void printHistory(std::ostream& stream);
+	/**
+	 * Print stats of current or last search to `stream`.
+	 */
+	void printStats(std::ostream& stream);
 
 private:
 	bool renderBoard(Color side) override;	
@@ -61,11 +93,14 @@ private:
 	void draw() override;
 
 	void fillMessageBuffer();
+	void printHint();
 	Color promptSide() noexcept;
 	static void clearTerminal() noexcept;
 	bool tryParse(std::string& s, Move& move) noexcept;
 	[[nodiscard]]
 	static bool parseOption(const std::string& s) noexcept;
+	[[nodiscard]]
+	static bool parseNumber(const std::string& s, unsigned& value) noexcept;
 
 	bool moved = false;
 };
@@ -18,6 +18,7 @@
 
 #include <cstdint>
 #include <cstring>
+#include <cmath>
 #include <chrono>
 #include <string_view>
 #include <string>
@@ -26,11 +27,62 @@
 #include <utility>
 #include <algorithm>
 #include <vector>
+#include <atomic>
+#include <memory>
+#include <future>
+#include <functional>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#ifdef KAREN_ENABLE_PARALLEL
+# include <thread>
+# include <condition_variable>
+#endif
 
 #ifndef NDEBUG
 # define KAREN_DEBUG
 #endif
 
+/* What search records about itself: 0 is nothing, 1 is counters of
+ * `Engine::ThinkInfo`, 2 is counters and timeline of iterations */
+#ifndef KAREN_INSTRUMENTATION
+# define KAREN_INSTRUMENTATION 1
+#endif
+
+/* Kernels for instruction sets which the compiler targets are always built,
+ * GCC and Clang build all x86-64 kernels and pick one at runtime */
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+# define KAREN_RUNTIME_DISPATCH
+# define KAREN_TARGET(features) __attribute__((target(features)))
+#else
+# define KAREN_TARGET(features)
+#endif
+#if defined(__GNUC__) || defined(__clang__)
+# define KAREN_ALWAYS_INLINE __attribute__((always_inline))
+# define KAREN_COLD __attribute__((cold, noinline))
+#elif defined(_MSC_VER)
+# define KAREN_ALWAYS_INLINE __forceinline
+# define KAREN_COLD __declspec(noinline)
+#else
+# define KAREN_ALWAYS_INLINE
+# define KAREN_COLD
+#endif
+#if defined(KAREN_RUNTIME_DISPATCH) || defined(__SSE2__)
+# define KAREN_SSE2_KERNELS
+#endif
+#if defined(KAREN_RUNTIME_DISPATCH) || (defined(__SSE4_2__) && defined(__POPCNT__))
+# define KAREN_POPCNT_KERNELS
+#endif
+#if defined(KAREN_RUNTIME_DISPATCH) || defined(__AVX2__)
+# define KAREN_AVX2_KERNELS
+#endif
+#if defined(KAREN_RUNTIME_DISPATCH) || (defined(__AVX2__) && defined(__BMI2__) && defined(__x86_64__))
+# define KAREN_BMI2_KERNELS
+#endif
+#if defined(KAREN_SSE2_KERNELS) || defined(KAREN_AVX2_KERNELS)
+# include <immintrin.h>
+#endif
+
 #ifndef KAREN_ASSERT
 	
 # ifndef NDEBUG /* enable assertions when debug */
@@ -38,14 +90,27 @@
 # endif
 	
 #ifdef KAREN_ENABLE_ASSERTIONS
+/* Message is built by lambda only when assertion fails, so
+ * code that concatenates strings stays out of hot paths */
 #define KAREN_ASSERT(cond, message)										\
-	if (!(cond)) { karen11::detail::reportAssertion(message, __LINE__, __FUNCTION__); }
+	do { if (!(cond)) karen11::detail::reportAssertion([&]() -> std::string { return message; }, \
+													   __LINE__, __FUNCTION__); } while (false)
 #else
 #define KAREN_ASSERT(cond, message)
 #endif
 
 #endif
 
+/* `Engine::validate()` is called after every that many calls of
+ * `doMove()` and `undoMove()`, 0 disables it */
+#ifndef KAREN_VALIDATE_INTERVAL
+# ifdef KAREN_ENABLE_ASSERTIONS
+#  define KAREN_VALIDATE_INTERVAL 1024
+# else
+#  define KAREN_VALIDATE_INTERVAL 0
+# endif
+#endif
+
 #define KAREN_OVERLOAD_ENUM_BIN_OPERATOR(op, type)						\
 	[[nodiscard]] inline constexpr type									\
 	operator op(type lhs, type rhs) noexcept							\
@@ -87,9 +152,10 @@ namespace karen11
 #ifdef KAREN_ENABLE_ASSERTIONS
 namespace detail
 {
-	inline void reportAssertion(const std::string& message, int line, const char* func)
+	template<typename F>
+	[[noreturn]] KAREN_COLD void reportAssertion(F&& message, int line, const char* func)
 	{
-		throw Error(message, line, func);
+		throw Error(message(), line, func);
 	}
 }
 #endif
@@ -520,6 +586,78 @@ inline constexpr bool isValid(Square square) noexcept
 	return toByte(square) < 64;
 }
 
+/**
+ * @brief Set of squares, bit N is set when square N belongs to set.
+ * See https://www.chessprogramming.org/Bitboards
+ */
+using Bitboard = uint64_t;
+
+inline constexpr Bitboard FILE_A = 0x0101'0101'0101'0101;
+inline constexpr Bitboard FILE_H = FILE_A << 7;
+inline constexpr Bitboard RANK_1 = 0xFF;
+
+[[nodiscard]]
+inline constexpr Bitboard toBitboard(Square square) noexcept
+{
+	return Bitboard(1) << toByte(square);
+}
+
+[[nodiscard]]
+inline constexpr Bitboard fileBitboard(byte x) noexcept
+{
+	return FILE_A << x;
+}
+
+[[nodiscard]]
+inline constexpr Bitboard rankBitboard(byte y) noexcept
+{
+	return RANK_1 << (y << 3);
+}
+
+/**
+ * @return files next to file `x`.
+ */
+[[nodiscard]]
+inline constexpr Bitboard adjacentFiles(byte x) noexcept
+{
+	return ((fileBitboard(x) << 1) & ~FILE_A) | ((fileBitboard(x) >> 1) & ~FILE_H);
+}
+
+/**
+ * @return number of squares in `bitboard`.
+ */
+[[nodiscard]]
+inline int popCount(Bitboard bitboard) noexcept
+{
+#if defined(__GNUC__) || defined(__clang__)
+	return __builtin_popcountll(bitboard);
+#else
+	int count = 0;
+	for (; bitboard; bitboard &= bitboard - 1)
+		count++;
+	return count;
+#endif
+}
+
+/**
+ * @return the first square of not empty `bitboard`.
+ */
+[[nodiscard]]
+inline Square firstSquare(Bitboard bitboard) noexcept
+{
+#if defined(__GNUC__) || defined(__clang__)
+	return static_cast<Square>(__builtin_ctzll(bitboard));
+#else
+	byte index = 0;
+	while (!(bitboard & 1))
+	{
+		bitboard >>= 1;
+		index++;
+	}
+	return static_cast<Square>(index);
+#endif
+}
+
 /**
  * @brief Represents move
  * @detail
@@ -632,6 +770,43 @@ inline constexpr Score ROOK_SCORE = 550;
  */
 inline constexpr Score QUEEN_SCORE = 1080;
 
+/**
+ * @brief Middlegame and endgame scores packed in one integer.
+ * Pairs are added and subtracted with a single integer operation.
+ * See https://www.chessprogramming.org/Tapered_Eval
+ */
+using ScorePair = int32_t;
+
+[[nodiscard]]
+inline constexpr ScorePair makeScore(Score middlegame, Score endgame) noexcept
+{
+	return ScorePair(uint32_t(endgame) << 16) + middlegame;
+}
+
+/**
+ * @brief Get middlegame part of `pair`.
+ */
+[[nodiscard]]
+inline constexpr Score middlegameScore(ScorePair pair) noexcept
+{
+	return int16_t(uint16_t(uint32_t(pair)));
+}
+
+/**
+ * @brief Get endgame part of `pair`.
+ */
+[[nodiscard]]
+inline constexpr Score endgameScore(ScorePair pair) noexcept
+{
+	return int16_t(uint16_t((uint32_t(pair) + 0x8000) >> 16));
+}
+
+/**
+ * @brief Game phase when all pieces are on the board.
+ * Knights and bishops give 1 point, rooks 2, queens 4.
+ */
+inline constexpr byte MIDDLEGAME_PHASE = 24;
+
 /**
  * @brief Represents chess board
  * Technically it's just an array of pieces.
@@ -668,6 +843,16 @@ public:
 		return data + 64;
 	}
 
+	const Piece* begin() const noexcept
+	{
+		return data;
+	}
+
+	const Piece* end() const noexcept
+	{
+		return data + 64;
+	}
+
 	static Board standard() noexcept
 	{
 		Board board;
@@ -742,174 +927,2374 @@ private:
 	Piece data[64];
 };
 
-struct Figure
-{
-	Square pos;
-	Figure* pNext;
-};
-using FigureList = Figure*;
-
-struct MoveEx
+/**
+ * @return index of `piece` in tables indexed by piece's code and color.
+ */
+[[nodiscard]]
+inline constexpr byte pieceIndex(Piece piece) noexcept
 {
-	int16_t score;
-	Move move;
-	
-	bool operator< (MoveEx rhs) const noexcept
-	{
-		return score < rhs.score;
-	}
-
-	bool operator> (MoveEx rhs) const noexcept
-	{
-		return score > rhs.score;
-	}
-};
+	return (toByte(piece) & 7) | ((toByte(piece) >> 4) & 8);
+}
 
 /**
- * Almost same to `std::vector` but uses stack memory.
- * Therefore it has constexpr capacity = `C`.
+ * @brief Read position in Forsyth-Edwards Notation.
+ * See https://www.chessprogramming.org/Forsyth-Edwards_Notation
+ * Piece placement, side to move and castling rights are read, the rest is ignored.
+ * Kings and rooks that can't castle are marked as moved.
+ * @throw std::invalid_argument if `fen` is malformed.
  */
-template<typename T, unsigned C = 256>
-class VectorOnStack
+inline Board parseFen(std::string_view fen, Color& side)
 {
-public:
-	using size_type = unsigned int;
-	using iterator = T*;
-	using const_iterator = const T*;
-	
-	static constexpr size_type capacity = C;
-	
-private:
-	byte bytes[capacity * sizeof(T)];
-	T* data;
-	size_type sz;
+	const auto error = [fen](const char* message) {
+		return std::invalid_argument("parseFen: " + std::string(message) + " in '" + std::string(fen) + "'");
+	};
+	constexpr std::string_view letters = " pnbrqk";
+	Board board;
+	std::fill(board.begin(), board.end(), Piece::EMPTY);
 
-public:
-	VectorOnStack() noexcept : data(reinterpret_cast<T*>(bytes)), sz(0) {}
-	VectorOnStack(size_type size) noexcept : VectorOnStack()
+	size_t i = 0;
+	byte x = 0, y = 7;
+	for (; i < fen.size() && fen[i] != ' '; i++)
 	{
-		if constexpr (!std::is_trivially_default_constructible_v<T>)
-						 while (sz < size)
-							 new(&data[sz]) T();
+		const char c = fen[i];
+		if (c == '/')
+		{
+			if (x != 8 || y == 0)
+				throw error("wrong rank size");
+			x = 0;
+			y--;
+		}
+		else if (c >= '1' && c <= '8' && x + (c - '0') <= 8)
+			x += c - '0';
+		else
+		{
+			const size_t code = letters.find(char(c | 0x20));
+			if (code == std::string_view::npos || code == 0 || x >= 8)
+				throw error("unexpected piece");
+			const Color color = (c & 0x20) ? Color::BLACK : Color::WHITE;
+			board[makeSquare(x++, y)] = static_cast<Piece>(byte(code) | toByte(color));
+		}
 	}
-	VectorOnStack(const VectorOnStack&) = default;
-	VectorOnStack(VectorOnStack&&) = default;
-	~VectorOnStack() noexcept
+	if (x != 8 || y != 0)
+		throw error("wrong number of ranks");
+	if (std::count(board.begin(), board.end(), Piece::WHITE_KING) != 1 ||
+		std::count(board.begin(), board.end(), Piece::BLACK_KING) != 1)
+		throw error("every side must have one king");
+
+	if (i + 2 > fen.size() || (fen[i + 1] != 'w' && fen[i + 1] != 'b'))
+		throw error("side to move is missing");
+	side = (fen[i + 1] == 'w') ? Color::WHITE : Color::BLACK;
+	i += 2;
+	std::string_view castling = (i < fen.size()) ? fen.substr(i + 1) : std::string_view{};
+	castling = castling.substr(0, castling.find(' '));
+
+	const auto canCastle = [castling](char right) noexcept {
+		return castling.find(right) != std::string_view::npos;
+	};
+	const struct
 	{
-		if constexpr (!std::is_trivially_destructible_v<T>)
-					 {
-						 for (auto& elem : *this)
-							 elem.~T();
-					 }
-	}
-
-	iterator begin() noexcept { return data; }
-	iterator end() noexcept { return data + sz; }
-	const_iterator begin() const noexcept { return data; }
-	const_iterator end() const noexcept { return data + sz; }
-	size_type size() const noexcept { return sz; }
+		Square square;
+		Piece piece;
+		bool allowed;
+	} unmoved[] = {
+		{ Square::E1, Piece::WHITE_KING, canCastle('K') || canCastle('Q') },
+		{ Square::H1, Piece::WHITE_ROOK, canCastle('K') },
+		{ Square::A1, Piece::WHITE_ROOK, canCastle('Q') },
+		{ Square::E8, Piece::BLACK_KING, canCastle('k') || canCastle('q') },
+		{ Square::H8, Piece::BLACK_ROOK, canCastle('k') },
+		{ Square::A8, Piece::BLACK_ROOK, canCastle('q') },
+	};
+	for (Piece& piece : board)
+		if (isKing(piece) || isRook(piece))
+			makeMoved(piece);
+	for (const auto& [square, piece, allowed] : unmoved)
+		if (allowed && static_cast<Piece>(toByte(board[square]) & 0b1011'1111) == piece)
+			board[square] = piece;
+	return board;
+}
 
+namespace detail
+{
 	/**
-	 * Get element of vector at `index`.
-	 * Warning: this function doesn't do checking for performance: if
-	 * `index >= size` then stack corruption will occur.
-	 */
-	T& operator[](size_type index) noexcept { return data[index]; }
-	/**
-	 * Get const element of vector at `index`.
-	 * Warning: this function doesn't do checking for performance: if
-	 * `index >= size` then stack corruption will occur.
+	 * @brief Random number generator that can be used at compile time.
+	 * See https://prng.di.unimi.it/splitmix64.c
 	 */
-	const T& operator[](size_type index) const noexcept { return data[index]; }
-
-	void push_back(T&& rvalue)
+	inline constexpr uint64_t splitMix64(uint64_t& seed) noexcept
 	{
-		KAREN_ASSERT(sz < capacity, "vector on stack : size is maximum");
-		new(&data[sz++]) T(std::move(rvalue));
+		uint64_t z = (seed += 0x9E37'79B9'7F4A'7C15);
+		z = (z ^ (z >> 30)) * 0xBF58'476D'1CE4'E5B9;
+		z = (z ^ (z >> 27)) * 0x94D0'49BB'1331'11EB;
+		return z ^ (z >> 31);
 	}
-	
-	void push_back(const T& lvalue)
+
+	struct ZobristKeys
 	{
-		KAREN_ASSERT(sz < capacity, "vector on stack : size is maximum");
-		new(&data[sz++]) T(lvalue);
-	}
+		/* [code | color] x [square] */
+		uint64_t pieces[16][64];
+		/* Xored for king and rooks that didn't move yet */
+		uint64_t castling[64];
+		/* [file of pawn that can be felled en passant], [8] means there's no such pawn */
+		uint64_t enPassant[9];
+		/* Xored when black is to move */
+		uint64_t side;
+		/* [code | color] x [number of such pieces before one more is added] */
+		uint64_t material[16][16];
+	};
 
-	void pop_back()
+	inline constexpr ZobristKeys makeZobristKeys() noexcept
 	{
-		KAREN_ASSERT(sz > 0, "vector on stack : size is 0");
-		data[sz].~T();
-		sz--;
+		ZobristKeys keys{};
+		uint64_t seed = 0x4B61'7265'6E31'31; /* "Karen11" */
+		for (auto& piece : keys.pieces)
+			for (auto& key : piece)
+				key = splitMix64(seed);
+		for (auto& key : keys.castling)
+			key = splitMix64(seed);
+		for (byte i = 0; i < 8; i++)
+			keys.enPassant[i] = splitMix64(seed);
+		keys.enPassant[8] = 0;
+		keys.side = splitMix64(seed);
+		for (auto& piece : keys.material)
+			for (auto& key : piece)
+				key = splitMix64(seed);
+		return keys;
 	}
+}
 
-	/**
-	 * @brief Erase element from vector at `pos`.
-	 * Complexity: O(N)
-	 * @return iterator that points to new element at `pos`.
-	 */
-	iterator erase(iterator pos)
+/**
+ * @brief Random keys for Zobrist hashing.
+ * See https://www.chessprogramming.org/Zobrist_Hashing
+ */
+inline constexpr detail::ZobristKeys zobrist = detail::makeZobristKeys();
+
+/**
+ * @return key of `piece` standing at `square`.
+ */
+[[nodiscard]]
+inline constexpr uint64_t pieceKey(Piece piece, Square square) noexcept
+{
+	if (piece == Piece::EMPTY)
+		return 0;
+	uint64_t key = zobrist.pieces[pieceIndex(piece)][toByte(square)];
+	/* King and rooks that didn't move make castling available */
+	if ((isKing(piece) || isRook(piece)) && !(toByte(piece) & 0b0100'0000))
+		key ^= zobrist.castling[toByte(square)];
+	return key;
+}
+
+namespace detail
+{
+	/* Piece-square tables seen by white. First row of every table is the first rank */
+	inline constexpr sbyte whitePawnTable[64] = {
+		0,   0,  0,  0,  0,  0,  0,  0,
+		0,   4,  4,  0,  0,  4,  4,  0,
+		2,   8,  2, 10, 10,  2,  8,  2,
+		4,   8, 12, 18, 18, 12,  8,  4,
+		6,  12, 16, 24, 24, 16, 12,  6,
+		8,  16, 24, 32, 32, 24, 16,  8,
+		20, 36, 36, 36, 36, 36, 36, 20,
+		0,   0,  0,  0,  0,  0,  0,  0,
+	};
+	inline constexpr sbyte knightTable[64] = {
+		0,  4,  8, 10, 10,  8,  4,  0,
+		4,  8, 20, 20, 20, 20,  8,  4,
+		8, 16, 24, 28, 28, 24, 16,  8,
+		10, 20, 28, 32, 32, 28, 20, 10,
+		10, 20, 28, 32, 32, 28, 20, 10,
+		8, 16, 24, 28, 28, 24, 16,  8,
+		4,  8, 20, 20, 20, 20,  8,  4,
+		0,  4,  8, 10, 10,  8,  4,  0,
+	};
+	inline constexpr sbyte bishopTable[64] = {
+		2, 0,  0,  0,  0,  0, 0, 2,
+		0, 8,  4,  4,  4,  4, 8, 0,
+		0, 4, 10, 10, 10, 10, 4, 0,
+		0, 4, 10, 10, 10, 10, 4, 0,
+		0, 4, 10, 10, 10, 10, 4, 0,
+		0, 4, 10, 10, 10, 10, 4, 0,
+		0, 8,  4,  4,  4,  4, 8, 0,
+		2, 0,  0,  0,  0,  0, 0, 2,
+	};
+	inline constexpr sbyte whiteRookTable[64] = {
+		0,  0, 0, 5, 5, 0, 0,  0,
+		-5, 0, 0, 0, 0, 0, 0, -5,
+		-5, 0, 0, 0, 0, 0, 0, -5,
+		-5, 0, 0, 0, 0, 0, 0, -5,
+		-5, 0, 0, 0, 0, 0, 0, -5,
+		-5, 0, 0, 0, 0, 0, 0, -5,
+		5,  7, 7, 7, 7, 7, 7,  5,
+		0,  0, 0, 0, 0, 0, 0,  0,
+	};
+	inline constexpr sbyte whiteQueenTable[64] = {
+		-20,-10,-10, -5, -5,-10,-10,-20,
+		-10,  0,  0,  0,  0,  0,  0,-10,
+		-10,  0,  5,  5,  5,  5,  0,-10,
+		-5,  0,  5,  5,  5,  5,  0,  0,
+		-5,  0,  5,  5,  5,  5,  0, -5,
+		-10,  5,  5,  5,  5,  5,  0,-10,
+		-10,  0,  5,  0,  0,  0,  0,-10,
+		-20,-10,-10, -5, -5,-10,-10,-20
+	};
+	inline constexpr sbyte whitePawnEndgameTable[64] = {
+		0,   0,  0,  0,  0,  0,  0,  0,
+		0,   0,  0,  0,  0,  0,  0,  0,
+		4,   4,  4,  4,  4,  4,  4,  4,
+		10, 10, 10, 10, 10, 10, 10, 10,
+		20, 20, 20, 20, 20, 20, 20, 20,
+		34, 34, 34, 34, 34, 34, 34, 34,
+		54, 54, 54, 54, 54, 54, 54, 54,
+		0,   0,  0,  0,  0,  0,  0,  0,
+	};
+	inline constexpr sbyte kingTable[64] = {
+		0,   0,  -4,  -10, -10,  -4,   0,   0,
+		-4, -4,  -8,  -12, -12,  -8,  -4,  -4,
+		-12, -16, -20, -20, -20, -20, -16, -12,
+		-16, -20, -24, -24, -24, -24, -20, -16,
+		-16, -20, -24, -24, -24, -24, -20, -16,
+		-12, -16, -20, -20, -20, -20, -16, -12,
+		-4, -4,  -8,  -12, -12,  -8,  -4,  -4,
+		0,   0,  -4,  -10, -10,  -4,   0,   0,
+	};
+	/* King must go to the center in endgame */
+	inline constexpr sbyte kingEndgameTable[64] = {
+		-30, -20, -12, -8, -8, -12, -20, -30,
+		-20, -10,  -2,  4,  4,  -2, -10, -20,
+		-12,  -2,  10, 16, 16,  10,  -2, -12,
+		-8,    4,  16, 24, 24,  16,   4,  -8,
+		-8,    4,  16, 24, 24,  16,   4,  -8,
+		-12,  -2,  10, 16, 16,  10,  -2, -12,
+		-20, -10,  -2,  4,  4,  -2, -10, -20,
+		-30, -20, -12, -8, -8, -12, -20, -30,
+	};
+}
+
+/**
+ * @brief Weights of hand-written evaluation terms, `karen_tune` finds them from games.
+ * Every weight is a middlegame and endgame score given for white,
+ * black pieces use the same weights mirrored.
+ */
+struct EvalWeights
+{
+	/* [code] */
+	ScorePair material[7];
+	/* [code] x [square], squares are seen by white */
+	ScorePair pieceSquares[7][64];
+	ScorePair doubledPawn;
+	ScorePair isolatedPawn;
+	ScorePair backwardPawn;
+	/* [relative rank] */
+	ScorePair passedPawn[8];
+	ScorePair bishopPair;
+	ScorePair noPawns;
+	/* For every knight and own pawn */
+	ScorePair knightPawn;
+	/* Castling is not available */
+	ScorePair noShortCastling;
+	ScorePair noLongCastling;
+};
+
+namespace detail
+{
+	inline constexpr EvalWeights makeEvalWeights() noexcept
 	{
-		KAREN_ASSERT(pos >= begin() && pos < end(),
-					 "VectorOnStack: passed iterator out of range [ begin(), end() )");
-		/* Call mecmpy when possible */
-		if constexpr (std::is_trivially_move_assignable_v<T>)
-						 std::memcpy(pos, pos + 1, (sz - (pos - data) - 1) * sizeof(T));
-		else
+		EvalWeights weights{};
+		const struct
 		{
-			auto it = pos;
-			while (it != end() - 1)
-				*it = std::move(*++it);
+			Code code;
+			Score value;
+			const sbyte* middlegame;
+			const sbyte* endgame;
+		} pieces[] = {
+			{ Code::PAWN, PAWN_SCORE, whitePawnTable, whitePawnEndgameTable },
+			{ Code::KNIGHT, KNIGHT_SCORE, knightTable, knightTable },
+			{ Code::BISHOP, BISHOP_SCORE, bishopTable, bishopTable },
+			{ Code::ROOK, ROOK_SCORE, whiteRookTable, whiteRookTable },
+			{ Code::QUEEN, QUEEN_SCORE, whiteQueenTable, whiteQueenTable },
+			{ Code::KING, ZERO, kingTable, kingEndgameTable },
+		};
+		for (const auto& [code, value, middlegame, endgame] : pieces)
+		{
+			weights.material[toByte(code)] = makeScore(value, value);
+			for (byte i = 0; i < 64; i++)
+				weights.pieceSquares[toByte(code)][i] = makeScore(middlegame[i], endgame[i]);
 		}
-		sz--;
-		end()->~T(); /* Calling last element's destructor */
-		return pos;
-	}
-    /**
-	 * Erase element from vector at `index`.
-	 * Complexity: O(N)
-	 */
-	iterator erase(size_type index)
-	{
-		return erase(begin() + index);
+		weights.doubledPawn = makeScore(-8, -18);
+		weights.isolatedPawn = makeScore(-10, -14);
+		weights.backwardPawn = makeScore(-8, -10);
+		const Score passed[8][2] = {
+			{0, 0}, {4, 10}, {8, 16}, {14, 26}, {24, 44}, {40, 70}, {64, 110}, {0, 0}
+		};
+		for (byte i = 0; i < 8; i++)
+			weights.passedPawn[i] = makeScore(passed[i][0], passed[i][1]);
+		weights.bishopPair = makeScore(18, 18);
+		weights.noPawns = makeScore(-50, -50);
+		weights.knightPawn = makeScore(2, 2);
+		weights.noShortCastling = makeScore(-25, -25);
+		weights.noLongCastling = makeScore(-23, -23);
+		return weights;
 	}
-};
-
-struct DummyType {};
+}
 
+#ifdef KAREN_EVAL_WEIGHTS
+/* Header written by `karen_tune`, it defines `evalWeights` */
+#include KAREN_EVAL_WEIGHTS
+#else
 /**
- * The main chess engine class.
+ * @brief Weights used by hand-written evaluation.
  */
-class Engine
+inline constexpr EvalWeights evalWeights = detail::makeEvalWeights();
+#endif
+
+namespace detail
 {
-public:
-	struct ThinkInfo
+	struct PieceSquareScores
 	{
-		std::chrono::milliseconds time;
-		unsigned positionsEvaluated = 0;
-		unsigned positionsTransfered = 0;
+		/* [code | color] x [square], positive for white and negative for black */
+		ScorePair pieces[16][64];
+		/* [code] */
+		byte phase[8];
 	};
 
-	struct MoveInfo
+	inline constexpr PieceSquareScores makePieceSquareScores() noexcept
 	{
-		byte enPassantAvailable = 8;
-		Move move;
+		PieceSquareScores scores{};
+		for (Color color : { Color::WHITE, Color::BLACK })
+			for (Code code : { Code::PAWN, Code::KNIGHT, Code::BISHOP, Code::ROOK, Code::QUEEN, Code::KING })
+			{
+				const bool white = color == Color::WHITE;
+				const ScorePair material = evalWeights.material[toByte(code)];
+				const ScorePair* table = evalWeights.pieceSquares[toByte(code)];
+				/* Black pieces see the board upside down */
+				for (byte i = 0; i < 64; i++)
+					scores.pieces[toByte(code) | (white ? 8 : 0)][i] =
+						white ? material + table[i] : -(material + table[i ^ 56]);
+			}
+		scores.phase[toByte(Code::KNIGHT)] = 1;
+		scores.phase[toByte(Code::BISHOP)] = 1;
+		scores.phase[toByte(Code::ROOK)] = 2;
+		scores.phase[toByte(Code::QUEEN)] = 4;
+		return scores;
+	}
+}
+
+/**
+ * @brief Material and piece-square scores.
+ * See https://www.chessprogramming.org/Piece-Square_Tables
+ */
+inline constexpr detail::PieceSquareScores pieceSquare = detail::makePieceSquareScores();
+
+/**
+ * @return material and position score of `piece` standing at `square`
+ * from white's point of view.
+ */
+[[nodiscard]]
+inline constexpr ScorePair pieceSquareScore(Piece piece, Square square) noexcept
+{
+	return pieceSquare.pieces[pieceIndex(piece)][toByte(square)];
+}
+
+/**
+ * @return how much `piece` contributes to game phase.
+ */
+[[nodiscard]]
+inline constexpr byte piecePhase(Piece piece) noexcept
+{
+	return pieceSquare.phase[toByte(get<Code>(piece))];
+}
+
+/**
+ * @brief Bitboards of pieces standing on `Board`.
+ */
+struct BoardMasks
+{
+	/* [white, black] */
+	Bitboard colors[2];
+	/* [code], pieces of both colors */
+	Bitboard codes[8];
+
+	[[nodiscard]]
+	Bitboard pieces(Color color, Code code) const noexcept
+	{
+		return codes[toByte(code)] & colors[(color == Color::WHITE) ? 0 : 1];
+	}
+
+	[[nodiscard]]
+	Bitboard occupied() const noexcept
+	{
+		return colors[0] | colors[1];
+	}
+};
+
+/**
+ * Hot loops of evaluation compiled for several instruction sets.
+ * `kernels` points to the best variant the CPU supports, see `detail::selectKernels()`.
+ */
+struct Kernels
+{
+	/* Name of instruction set kernels use */
+	const char* name;
+	/**
+	 * @brief Build bitboards of all pieces on board.
+	 */
+	BoardMasks (*boardMasks)(const Board& board) noexcept;
+	/**
+	 * @brief Sum `pieceSquareScore()` of all pieces on board.
+	 */
+	ScorePair (*boardScore)(const Board& board) noexcept;
+	/**
+	 * @brief Squares attacked by a bishop, including the first occupied square in each direction.
+	 */
+	Bitboard (*bishopAttacks)(Square square, Bitboard occupied) noexcept;
+	/**
+	 * @brief Squares attacked by a rook, including the first occupied square in each direction.
+	 */
+	Bitboard (*rookAttacks)(Square square, Bitboard occupied) noexcept;
+	/**
+	 * @brief Mobility of bishops, rooks and queens of `color`.
+	 */
+	Score (*sliderMobility)(const BoardMasks& masks, Color color) noexcept;
+	/**
+	 * @brief Add `count` `weights` to `values`, both arrays are aligned to 32 bytes.
+	 */
+	void (*addWeights)(int16_t* values, const int16_t* weights, unsigned count) noexcept;
+	/**
+	 * @brief Subtract `count` `weights` from `values`, both arrays are aligned to 32 bytes.
+	 */
+	void (*subWeights)(int16_t* values, const int16_t* weights, unsigned count) noexcept;
+	/**
+	 * @return sum of `weights` multiplied by `values` clamped to [0..max].
+	 */
+	int32_t (*clippedDot)(const int16_t* values, const int16_t* weights, unsigned count, int16_t max) noexcept;
+};
+
+namespace detail
+{
+	[[nodiscard]]
+	inline BoardMasks boardMasksScalar(const Board& board) noexcept
+	{
+		BoardMasks masks{};
+		const Piece* data = board.begin();
+		for (byte i = 0; i < 64; i++)
+		{
+			if (data[i] == Piece::EMPTY)
+				continue;
+			masks.colors[(get<Color>(data[i]) == Color::WHITE) ? 0 : 1] |= Bitboard(1) << i;
+			masks.codes[toByte(get<Code>(data[i]))] |= Bitboard(1) << i;
+		}
+		return masks;
+	}
+
+	[[nodiscard]]
+	inline ScorePair boardScoreScalar(const Board& board) noexcept
+	{
+		const Piece* data = board.begin();
+		ScorePair sum = 0;
+		for (byte i = 0; i < 64; i++)
+			sum += pieceSquare.pieces[pieceIndex(data[i])][i];
+		return sum;
+	}
+
+	template<int count>
+	KAREN_ALWAYS_INLINE inline Bitboard shifted(Bitboard bitboard) noexcept
+	{
+		if constexpr (count > 0)
+			return bitboard << count;
+		else
+			return bitboard >> -count;
+	}
+
+	/**
+	 * @brief Squares attacked by a slider at `from` in direction of bitboard shift `step`.
+	 * @param mask squares a step can land on, it excludes the file a step wraps to.
+	 * See https://www.chessprogramming.org/Kogge-Stone_Algorithm
+	 */
+	template<int step>
+	KAREN_ALWAYS_INLINE inline Bitboard rayAttacks(Bitboard from, Bitboard empty, Bitboard mask) noexcept
+	{
+		Bitboard pro = empty & mask;
+		from |= pro & shifted<step>(from);
+		pro &= shifted<step>(pro);
+		from |= pro & shifted<step * 2>(from);
+		pro &= shifted<step * 2>(pro);
+		from |= pro & shifted<step * 4>(from);
+		return shifted<step>(from) & mask;
+	}
+
+	[[nodiscard]]
+	KAREN_ALWAYS_INLINE inline Bitboard bishopAttacksScalar(Square square, Bitboard occupied) noexcept
+	{
+		const Bitboard from = toBitboard(square);
+		return rayAttacks<9>(from, ~occupied, ~FILE_A) | rayAttacks<7>(from, ~occupied, ~FILE_H) |
+			rayAttacks<-7>(from, ~occupied, ~FILE_A) | rayAttacks<-9>(from, ~occupied, ~FILE_H);
+	}
+
+	[[nodiscard]]
+	KAREN_ALWAYS_INLINE inline Bitboard rookAttacksScalar(Square square, Bitboard occupied) noexcept
+	{
+		const Bitboard from = toBitboard(square);
+		return rayAttacks<8>(from, ~occupied, ~Bitboard(0)) | rayAttacks<1>(from, ~occupied, ~FILE_A) |
+			rayAttacks<-8>(from, ~occupied, ~Bitboard(0)) | rayAttacks<-1>(from, ~occupied, ~FILE_H);
+	}
+
+	/**
+	 * @brief Evaluate mobility of sliders: every empty square a slider attacks gives 1 point
+	 * and every attacked enemy gives 2. Rooks also get bonus for defending rooks and queens
+	 * and for standing next to them.
+	 * @detail It's inlined into kernels compiled for different instruction sets.
+	 */
+	template<Bitboard (*bishopAttacks)(Square, Bitboard) noexcept, Bitboard (*rookAttacks)(Square, Bitboard) noexcept>
+	[[nodiscard]]
+	KAREN_ALWAYS_INLINE inline Score sliderMobility(const BoardMasks& masks, Color color) noexcept
+	{
+		const Bitboard occupied = masks.occupied();
+		const Bitboard enemies = masks.colors[(color == Color::WHITE) ? 1 : 0];
+		const Bitboard rooks = masks.pieces(color, Code::ROOK);
+		const Bitboard heavy = rooks | masks.pieces(color, Code::QUEEN);
+		Score score = ZERO;
+		for (Bitboard pieces = masks.pieces(color, Code::BISHOP) | masks.pieces(color, Code::QUEEN); pieces; pieces &= pieces - 1)
+		{
+			const Bitboard attacks = bishopAttacks(firstSquare(pieces), occupied);
+			score += popCount(attacks & ~occupied) + 2 * popCount(attacks & enemies);
+		}
+		for (Bitboard pieces = heavy; pieces; pieces &= pieces - 1)
+		{
+			const Bitboard piece = pieces & -pieces;
+			const Bitboard attacks = rookAttacks(firstSquare(piece), occupied);
+			score += popCount(attacks & ~occupied) + 2 * popCount(attacks & enemies);
+			if (piece & rooks)
+			{
+				const Bitboard neighbours = ((piece << 1) & ~FILE_A) | ((piece >> 1) & ~FILE_H) | (piece << 8) | (piece >> 8);
+				score += 4 * popCount(attacks & heavy) + 5 * popCount(neighbours & heavy);
+			}
+		}
+		return score;
+	}
+
+	inline void addWeightsScalar(int16_t* values, const int16_t* weights, unsigned count) noexcept
+	{
+		for (unsigned i = 0; i < count; i++)
+			values[i] += weights[i];
+	}
+
+	inline void subWeightsScalar(int16_t* values, const int16_t* weights, unsigned count) noexcept
+	{
+		for (unsigned i = 0; i < count; i++)
+			values[i] -= weights[i];
+	}
+
+	[[nodiscard]]
+	inline int32_t clippedDotScalar(const int16_t* values, const int16_t* weights, unsigned count, int16_t max) noexcept
+	{
+		int32_t sum = 0;
+		for (unsigned i = 0; i < count; i++)
+			sum += std::clamp<int32_t>(values[i], 0, max) * weights[i];
+		return sum;
+	}
+
+#ifdef KAREN_SSE2_KERNELS
+	/* Squares are compared with every piece code at once, the highest bit
+	 * of a piece is its color so white pieces are found with a single movemask */
+	KAREN_TARGET("sse2")
+	inline BoardMasks boardMasksSse2(const Board& board) noexcept
+	{
+		BoardMasks masks{};
+		const Piece* data = board.begin();
+		const __m128i codeMask = _mm_set1_epi8(7);
+		for (byte quarter = 0; quarter < 4; quarter++)
+		{
+			const __m128i pieces = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + quarter * 16));
+			const __m128i codes = _mm_and_si128(pieces, codeMask);
+			const byte shift = quarter * 16;
+			const Bitboard white = unsigned(_mm_movemask_epi8(pieces));
+			const Bitboard empty = unsigned(_mm_movemask_epi8(_mm_cmpeq_epi8(pieces, _mm_setzero_si128())));
+			masks.colors[0] |= white << shift;
+			masks.colors[1] |= (~(white | empty) & 0xFFFF) << shift;
+			for (byte code = toByte(Code::PAWN); code <= toByte(Code::KING); code++)
+				masks.codes[code] |= Bitboard(unsigned(_mm_movemask_epi8(
+					_mm_cmpeq_epi8(codes, _mm_set1_epi8(code))))) << shift;
+		}
+		return masks;
+	}
+
+	KAREN_TARGET("sse2")
+	inline void addWeightsSse2(int16_t* values, const int16_t* weights, unsigned count) noexcept
+	{
+		for (unsigned i = 0; i < count; i += 8)
+		{
+			auto v = reinterpret_cast<__m128i*>(values + i);
+			const auto w = reinterpret_cast<const __m128i*>(weights + i);
+			_mm_store_si128(v, _mm_add_epi16(_mm_load_si128(v), _mm_load_si128(w)));
+		}
+	}
+
+	KAREN_TARGET("sse2")
+	inline void subWeightsSse2(int16_t* values, const int16_t* weights, unsigned count) noexcept
+	{
+		for (unsigned i = 0; i < count; i += 8)
+		{
+			auto v = reinterpret_cast<__m128i*>(values + i);
+			const auto w = reinterpret_cast<const __m128i*>(weights + i);
+			_mm_store_si128(v, _mm_sub_epi16(_mm_load_si128(v), _mm_load_si128(w)));
+		}
+	}
+
+	KAREN_TARGET("sse2")
+	inline int32_t clippedDotSse2(const int16_t* values, const int16_t* weights, unsigned count, int16_t max) noexcept
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i high = _mm_set1_epi16(max);
+		__m128i sum = _mm_setzero_si128();
+		for (unsigned i = 0; i < count; i += 8)
+		{
+			const __m128i v = _mm_load_si128(reinterpret_cast<const __m128i*>(values + i));
+			const __m128i w = _mm_load_si128(reinterpret_cast<const __m128i*>(weights + i));
+			sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_min_epi16(_mm_max_epi16(v, zero), high), w));
+		}
+		sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0b01'00'11'10));
+		sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0b10'11'00'01));
+		return _mm_cvtsi128_si32(sum);
+	}
+
+#endif
+
+#ifdef KAREN_POPCNT_KERNELS
+	KAREN_TARGET("sse4.2,popcnt")
+	inline Score sliderMobilityPopcnt(const BoardMasks& masks, Color color) noexcept
+	{
+		return sliderMobility<bishopAttacksScalar, rookAttacksScalar>(masks, color);
+	}
+#endif
+
+#ifdef KAREN_AVX2_KERNELS
+	KAREN_TARGET("avx2")
+	inline BoardMasks boardMasksAvx2(const Board& board) noexcept
+	{
+		BoardMasks masks{};
+		const Piece* data = board.begin();
+		const __m256i codeMask = _mm256_set1_epi8(7);
+		for (byte half = 0; half < 2; half++)
+		{
+			const __m256i pieces = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + half * 32));
+			const __m256i codes = _mm256_and_si256(pieces, codeMask);
+			const byte shift = half * 32;
+			const Bitboard white = uint32_t(_mm256_movemask_epi8(pieces));
+			const Bitboard empty = uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(pieces, _mm256_setzero_si256())));
+			masks.colors[0] |= white << shift;
+			masks.colors[1] |= (~(white | empty) & 0xFFFF'FFFF) << shift;
+			for (byte code = toByte(Code::PAWN); code <= toByte(Code::KING); code++)
+				masks.codes[code] |= Bitboard(uint32_t(_mm256_movemask_epi8(
+					_mm256_cmpeq_epi8(codes, _mm256_set1_epi8(code))))) << shift;
+		}
+		return masks;
+	}
+
+	/* Empty squares have index 0 and zero scores so they're gathered too */
+	KAREN_TARGET("avx2")
+	inline ScorePair boardScoreAvx2(const Board& board) noexcept
+	{
+		const Piece* data = board.begin();
+		const int* table = &pieceSquare.pieces[0][0];
+		const __m256i codeMask = _mm256_set1_epi32(7);
+		const __m256i colorMask = _mm256_set1_epi32(8);
+		__m256i squares = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+		__m256i sum = _mm256_setzero_si256();
+		for (byte i = 0; i < 64; i += 8)
+		{
+			const __m256i pieces = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(data + i)));
+			const __m256i index = _mm256_or_si256(_mm256_and_si256(pieces, codeMask),
+												  _mm256_and_si256(_mm256_srli_epi32(pieces, 4), colorMask));
+			sum = _mm256_add_epi32(sum, _mm256_i32gather_epi32(table, _mm256_or_si256(_mm256_slli_epi32(index, 6), squares), 4));
+			squares = _mm256_add_epi32(squares, _mm256_set1_epi32(8));
+		}
+		__m128i half = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+		half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0b01'00'11'10));
+		half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0b10'11'00'01));
+		return _mm_cvtsi128_si32(half);
+	}
+
+	KAREN_TARGET("avx2")
+	inline __m256i shiftLanes(__m256i value, __m256i left, __m256i right) noexcept
+	{
+		return _mm256_or_si256(_mm256_sllv_epi64(value, left), _mm256_srlv_epi64(value, right));
+	}
+
+	inline constexpr int bishop_steps[4] = { 9, 7, -7, -9 };
+	inline constexpr Bitboard bishop_masks[4] = { ~FILE_A, ~FILE_H, ~FILE_A, ~FILE_H };
+	inline constexpr int rook_steps[4] = { 8, 1, -8, -1 };
+	inline constexpr Bitboard rook_masks[4] = { ~Bitboard(0), ~FILE_A, ~Bitboard(0), ~FILE_H };
+
+	/* Same as `rayAttacks()` in 4 directions at once, each lane fills one direction.
+	 * Shift counts over 63 give zero so every lane is shifted both left and right */
+	KAREN_TARGET("avx2")
+	inline Bitboard slidingAttacksAvx2(Bitboard from, Bitboard empty, const int (&steps)[4], const Bitboard (&masks)[4]) noexcept
+	{
+		const __m256i left1 = _mm256_setr_epi64x(steps[0] > 0 ? steps[0] : 64, steps[1] > 0 ? steps[1] : 64,
+												 steps[2] > 0 ? steps[2] : 64, steps[3] > 0 ? steps[3] : 64);
+		const __m256i right1 = _mm256_setr_epi64x(steps[0] < 0 ? -steps[0] : 64, steps[1] < 0 ? -steps[1] : 64,
+												  steps[2] < 0 ? -steps[2] : 64, steps[3] < 0 ? -steps[3] : 64);
+		const __m256i left2 = _mm256_slli_epi64(left1, 1), right2 = _mm256_slli_epi64(right1, 1);
+		const __m256i left4 = _mm256_slli_epi64(left1, 2), right4 = _mm256_slli_epi64(right1, 2);
+		const __m256i mask = _mm256_setr_epi64x(masks[0], masks[1], masks[2], masks[3]);
+		__m256i gen = _mm256_set1_epi64x(from);
+		__m256i pro = _mm256_and_si256(_mm256_set1_epi64x(empty), mask);
+		gen = _mm256_or_si256(gen, _mm256_and_si256(pro, shiftLanes(gen, left1, right1)));
+		pro = _mm256_and_si256(pro, shiftLanes(pro, left1, right1));
+		gen = _mm256_or_si256(gen, _mm256_and_si256(pro, shiftLanes(gen, left2, right2)));
+		pro = _mm256_and_si256(pro, shiftLanes(pro, left2, right2));
+		gen = _mm256_or_si256(gen, _mm256_and_si256(pro, shiftLanes(gen, left4, right4)));
+		const __m256i attacks = _mm256_and_si256(shiftLanes(gen, left1, right1), mask);
+		const __m128i half = _mm_or_si128(_mm256_castsi256_si128(attacks), _mm256_extracti128_si256(attacks, 1));
+		return Bitboard(_mm_cvtsi128_si64(half)) | Bitboard(_mm_extract_epi64(half, 1));
+	}
+
+	KAREN_TARGET("avx2")
+	inline Bitboard bishopAttacksAvx2(Square square, Bitboard occupied) noexcept
+	{
+		return slidingAttacksAvx2(toBitboard(square), ~occupied, bishop_steps, bishop_masks);
+	}
+
+	KAREN_TARGET("avx2")
+	inline Bitboard rookAttacksAvx2(Square square, Bitboard occupied) noexcept
+	{
+		return slidingAttacksAvx2(toBitboard(square), ~occupied, rook_steps, rook_masks);
+	}
+
+	KAREN_TARGET("avx2,popcnt")
+	inline Score sliderMobilityAvx2(const BoardMasks& masks, Color color) noexcept
+	{
+		return sliderMobility<bishopAttacksAvx2, rookAttacksAvx2>(masks, color);
+	}
+
+	KAREN_TARGET("avx2")
+	inline void addWeightsAvx2(int16_t* values, const int16_t* weights, unsigned count) noexcept
+	{
+		for (unsigned i = 0; i < count; i += 16)
+		{
+			auto v = reinterpret_cast<__m256i*>(values + i);
+			const auto w = reinterpret_cast<const __m256i*>(weights + i);
+			_mm256_store_si256(v, _mm256_add_epi16(_mm256_load_si256(v), _mm256_load_si256(w)));
+		}
+	}
+
+	KAREN_TARGET("avx2")
+	inline void subWeightsAvx2(int16_t* values, const int16_t* weights, unsigned count) noexcept
+	{
+		for (unsigned i = 0; i < count; i += 16)
+		{
+			auto v = reinterpret_cast<__m256i*>(values + i);
+			const auto w = reinterpret_cast<const __m256i*>(weights + i);
+			_mm256_store_si256(v, _mm256_sub_epi16(_mm256_load_si256(v), _mm256_load_si256(w)));
+		}
+	}
+
+	KAREN_TARGET("avx2")
+	inline int32_t clippedDotAvx2(const int16_t* values, const int16_t* weights, unsigned count, int16_t max) noexcept
+	{
+		const __m256i zero = _mm256_setzero_si256();
+		const __m256i high = _mm256_set1_epi16(max);
+		__m256i sum = _mm256_setzero_si256();
+		for (unsigned i = 0; i < count; i += 16)
+		{
+			const __m256i v = _mm256_load_si256(reinterpret_cast<const __m256i*>(values + i));
+			const __m256i w = _mm256_load_si256(reinterpret_cast<const __m256i*>(weights + i));
+			sum = _mm256_add_epi32(sum, _mm256_madd_epi16(_mm256_min_epi16(_mm256_max_epi16(v, zero), high), w));
+		}
+		__m128i half = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+		half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0b01'00'11'10));
+		half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0b10'11'00'01));
+		return _mm_cvtsi128_si32(half);
+	}
+#endif
+
+#ifdef KAREN_BMI2_KERNELS
+	/**
+	 * Slider attacks for every subset of squares that can block a slider,
+	 * subset is turned into index with PEXT instruction.
+	 * See https://www.chessprogramming.org/BMI2#PEXTBitboards
+	 */
+	struct PextAttacks
+	{
+		/* [bishop, rook] x [square], squares which can block a slider, board edges are excluded */
+		Bitboard blockers[2][64];
+		/* [bishop, rook] x [square] */
+		const Bitboard* attacks[2][64];
+		std::vector<Bitboard> table;
+	};
+
+	/**
+	 * @brief Fill `PextAttacks` for both sliders, it takes ~850 KB.
+	 */
+	inline std::unique_ptr<PextAttacks> makePextAttacks()
+	{
+		auto pext = std::make_unique<PextAttacks>();
+		std::size_t offsets[2][64];
+		std::size_t size = 0;
+		for (byte slider = 0; slider < 2; slider++)
+		{
+			for (byte i = 0; i < 64; i++)
+			{
+				const auto square = static_cast<Square>(i);
+				const Bitboard edges = ((RANK_1 | rankBitboard(7)) & ~rankBitboard(getY(square))) |
+					((FILE_A | FILE_H) & ~fileBitboard(getX(square)));
+				const Bitboard attacks = slider ? rookAttacksScalar(square, 0) : bishopAttacksScalar(square, 0);
+				pext->blockers[slider][i] = attacks & ~edges;
+				offsets[slider][i] = size;
+				size += std::size_t(1) << popCount(pext->blockers[slider][i]);
+			}
+		}
+		pext->table.resize(size);
+		for (byte slider = 0; slider < 2; slider++)
+		{
+			for (byte i = 0; i < 64; i++)
+			{
+				const auto square = static_cast<Square>(i);
+				const Bitboard blockers = pext->blockers[slider][i];
+				Bitboard* attacks = pext->table.data() + offsets[slider][i];
+				pext->attacks[slider][i] = attacks;
+				/* Subsets are enumerated in order of their PEXT indices */
+				Bitboard subset = 0;
+				do
+				{
+					*attacks++ = slider ? rookAttacksScalar(square, subset) : bishopAttacksScalar(square, subset);
+					subset = (subset - blockers) & blockers;
+				} while (subset);
+			}
+		}
+		return pext;
+	}
+
+	/* Filled by `selectKernels()` when BMI2 kernels are used */
+	inline std::unique_ptr<PextAttacks> pextAttacks;
+
+	KAREN_TARGET("bmi2")
+	inline Bitboard bishopAttacksPext(Square square, Bitboard occupied) noexcept
+	{
+		const byte i = toByte(square);
+		return pextAttacks->attacks[0][i][_pext_u64(occupied, pextAttacks->blockers[0][i])];
+	}
+
+	KAREN_TARGET("bmi2")
+	inline Bitboard rookAttacksPext(Square square, Bitboard occupied) noexcept
+	{
+		const byte i = toByte(square);
+		return pextAttacks->attacks[1][i][_pext_u64(occupied, pextAttacks->blockers[1][i])];
+	}
+
+	KAREN_TARGET("avx2,bmi2,popcnt")
+	inline Score sliderMobilityPext(const BoardMasks& masks, Color color) noexcept
+	{
+		return sliderMobility<bishopAttacksPext, rookAttacksPext>(masks, color);
+	}
+#endif
+
+	/**
+	 * @brief Kernels written in plain C++, SIMD kernels must give same results.
+	 */
+	inline Kernels scalarKernels() noexcept
+	{
+		return {
+			"scalar", boardMasksScalar, boardScoreScalar, bishopAttacksScalar, rookAttacksScalar,
+			sliderMobility<bishopAttacksScalar, rookAttacksScalar>,
+			addWeightsScalar, subWeightsScalar, clippedDotScalar,
+		};
+	}
+
+	/**
+	 * @brief Find kernel sets this CPU supports.
+	 * @detail CPU features are detected with cpuid when Karen is compiled with GCC or Clang
+	 * for x86-64, otherwise kernels are chosen by compiler's flags.
+	 * Every set replaces some kernels of the previous one with faster ones.
+	 * @return sets from scalar one to the fastest one.
+	 */
+	inline std::vector<Kernels> supportedKernels()
+	{
+		Kernels kernels = scalarKernels();
+		std::vector<Kernels> sets = { kernels };
+#ifdef KAREN_RUNTIME_DISPATCH
+		__builtin_cpu_init();
+		const bool popcnt = __builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt");
+		const bool avx2 = popcnt && __builtin_cpu_supports("avx2");
+		/* PEXT is microcoded and slow on AMD CPUs before Zen 3 */
+		const bool bmi2 = avx2 && __builtin_cpu_supports("bmi2") &&
+			!__builtin_cpu_is("znver1") && !__builtin_cpu_is("znver2");
+#else
+		/* Only kernels target CPU supports are compiled */
+		[[maybe_unused]] constexpr bool popcnt = true, avx2 = true, bmi2 = true;
+#endif
+#ifdef KAREN_SSE2_KERNELS
+		kernels.name = "SSE2";
+		kernels.boardMasks = boardMasksSse2;
+		kernels.addWeights = addWeightsSse2;
+		kernels.subWeights = subWeightsSse2;
+		kernels.clippedDot = clippedDotSse2;
+		sets.push_back(kernels);
+#endif
+#ifdef KAREN_POPCNT_KERNELS
+		if (popcnt)
+		{
+			kernels.name = "SSE4.2+POPCNT";
+			kernels.sliderMobility = sliderMobilityPopcnt;
+			sets.push_back(kernels);
+		}
+#endif
+#ifdef KAREN_AVX2_KERNELS
+		if (avx2)
+		{
+			kernels = {
+				"AVX2", boardMasksAvx2, boardScoreAvx2, bishopAttacksAvx2, rookAttacksAvx2,
+				sliderMobilityAvx2, addWeightsAvx2, subWeightsAvx2, clippedDotAvx2,
+			};
+			sets.push_back(kernels);
+		}
+#endif
+#ifdef KAREN_BMI2_KERNELS
+		if (bmi2)
+		{
+			if (!pextAttacks)
+				pextAttacks = makePextAttacks();
+			kernels.name = "AVX2+BMI2";
+			kernels.bishopAttacks = bishopAttacksPext;
+			kernels.rookAttacks = rookAttacksPext;
+			kernels.sliderMobility = sliderMobilityPext;
+			sets.push_back(kernels);
+		}
+#endif
+		return sets;
+	}
+
+	/**
+	 * @brief Choose the fastest kernels.
+	 */
+	inline Kernels selectKernels()
+	{
+		return supportedKernels().back();
+	}
+}
+
+/**
+ * @brief Kernels chosen for this CPU at startup.
+ */
+inline const Kernels kernels = detail::selectKernels();
+
+/**
+ * @brief Build bitboards of all pieces on `board`.
+ */
+[[nodiscard]]
+inline BoardMasks boardMasks(const Board& board) noexcept
+{
+	return kernels.boardMasks(board);
+}
+
+/**
+ * @brief Sum `pieceSquareScore()` of all pieces on `board`.
+ * @detail Engine updates this sum incrementally, computing it from scratch
+ * is needed only to check that incremental updates are right.
+ */
+[[nodiscard]]
+inline ScorePair boardScore(const Board& board) noexcept
+{
+	return kernels.boardScore(board);
+}
+
+/**
+ * @return squares attacked by a bishop at `square`, including the first occupied square in each direction.
+ */
+[[nodiscard]]
+inline Bitboard bishopAttacks(Square square, Bitboard occupied) noexcept
+{
+	return kernels.bishopAttacks(square, occupied);
+}
+
+/**
+ * @return squares attacked by a rook at `square`, including the first occupied square in each direction.
+ */
+[[nodiscard]]
+inline Bitboard rookAttacks(Square square, Bitboard occupied) noexcept
+{
+	return kernels.rookAttacks(square, occupied);
+}
+
+/**
+ * Hash table that stores results of search.
+ * See https://www.chessprogramming.org/Transposition_Table
+ * Table is shared between threads: entries are written without locks and
+ * key is stored xored with data so torn entries are rejected by `probe()`.
+ */
+class TranspositionTable
+{
+public:
+	enum class Bound : byte { NONE, UPPER, LOWER, EXACT };
+
+	struct Entry
+	{
+		Move move;
+		int16_t score;
+		sbyte depth;
+		Bound bound;
+	};
+
+	explicit TranspositionTable(unsigned megabytes = 16)
+	{
+		resize(megabytes);
+	}
+
+	/**
+	 * @brief Resize table to fit in `megabytes` and clear it.
+	 * Must not be called when table is used by search.
+	 */
+	void resize(unsigned megabytes)
+	{
+		size_t count = 1;
+		while (count * 2 * sizeof(Slot) <= size_t(std::max(megabytes, 1u)) << 20)
+			count *= 2;
+		slots = std::make_unique<Slot[]>(count);
+		mask = count - 1;
+		clear();
+	}
+
+	void clear() noexcept
+	{
+		for (size_t i = 0; i <= mask; i++)
+		{
+			slots[i].key.store(0, std::memory_order_relaxed);
+			slots[i].data.store(0, std::memory_order_relaxed);
+		}
+		generation = 0;
+	}
+
+	/**
+	 * @brief Tell table that new search started so old entries can be replaced.
+	 */
+	void newSearch() noexcept
+	{
+		generation = (generation + 1) & 63;
+	}
+
+	/**
+	 * @return true if `key` was found, `entry` is filled then.
+	 */
+	[[nodiscard]]
+	bool probe(uint64_t key, Entry& entry) const noexcept
+	{
+		const Slot& slot = slots[key & mask];
+		const uint64_t data = slot.data.load(std::memory_order_relaxed);
+		if ((slot.key.load(std::memory_order_relaxed) ^ data) != key || data == 0)
+			return false;
+		entry = unpack(data);
+		return true;
+	}
+
+	/**
+	 * @brief Store entry for position with hash `key`.
+	 * @return false if another thread wrote the same slot since it was read here,
+	 * this store is dropped then and the other thread's entry is kept.
+	 */
+	bool store(uint64_t key, Move move, Score score, int depth, Bound bound) noexcept
+	{
+		Slot& slot = slots[key & mask];
+		const uint64_t old = slot.data.load(std::memory_order_relaxed);
+		const bool sameKey = (slot.key.load(std::memory_order_relaxed) ^ old) == key;
+		if (old != 0 && !sameKey &&
+			((old >> 42) & 63) == generation &&
+			sbyte(old >> 32) > depth && bound != Bound::EXACT)
+			return true; /* keep deeper entry of current search */
+		if (sameKey && move == makeMove(Square::A1, Square::A1))
+			move = unpack(old).move; /* keep old best move */
+		const uint64_t data =
+			uint64_t(static_cast<uint16_t>(move)) |
+			(uint64_t(uint16_t(int16_t(score))) << 16) |
+			(uint64_t(byte(sbyte(std::clamp(depth, -128, 127)))) << 32) |
+			(uint64_t(toByte(bound)) << 40) |
+			(uint64_t(generation) << 42);
+		uint64_t expected = old;
+		if (!slot.data.compare_exchange_strong(expected, data, std::memory_order_relaxed))
+			return false;
+		slot.key.store(key ^ data, std::memory_order_relaxed);
+		return true;
+	}
+
+private:
+	struct Slot
+	{
+		std::atomic<uint64_t> key;
+		std::atomic<uint64_t> data;
+	};
+
+	std::unique_ptr<Slot[]> slots;
+	size_t mask = 0;
+	byte generation = 0;
+
+	static Entry unpack(uint64_t data) noexcept
+	{
+		return Entry{
+			static_cast<Move>(uint16_t(data)),
+			int16_t(uint16_t(data >> 16)),
+			sbyte(byte(data >> 32)),
+			static_cast<Bound>((data >> 40) & 3),
+		};
+	}
+};
+
+/**
+ * Cache of static evaluation.
+ * See https://www.chessprogramming.org/Evaluation_Hash_Table
+ * Every slot is a single 64-bit word: upper bits of key and 16-bit score,
+ * so it's shared between threads without locks and can't be torn.
+ */
+class EvalCache
+{
+public:
+	explicit EvalCache(unsigned kilobytes = 256)
+	{
+		resize(kilobytes);
+	}
+
+	/**
+	 * @brief Resize cache to fit in `kilobytes` and clear it.
+	 * Must not be called when cache is used by search.
+	 */
+	void resize(unsigned kilobytes)
+	{
+		size_t count = 1;
+		while (count * 2 * sizeof(uint64_t) <= size_t(std::max(kilobytes, 1u)) << 10)
+			count *= 2;
+		slots = std::make_unique<std::atomic<uint64_t>[]>(count);
+		mask = count - 1;
+		clear();
+	}
+
+	void clear() noexcept
+	{
+		for (size_t i = 0; i <= mask; i++)
+			slots[i].store(0, std::memory_order_relaxed);
+	}
+
+	/**
+	 * @return true if `key` was found, `score` is filled then.
+	 */
+	[[nodiscard]]
+	bool probe(uint64_t key, Score& score) const noexcept
+	{
+		const uint64_t data = slots[key & mask].load(std::memory_order_relaxed);
+		if ((data ^ key) & ~uint64_t(0xFFFF))
+			return false;
+		score = int16_t(uint16_t(data));
+		return true;
+	}
+
+	void store(uint64_t key, Score score) noexcept
+	{
+		slots[key & mask].store((key & ~uint64_t(0xFFFF)) | uint16_t(int16_t(score)),
+								std::memory_order_relaxed);
+	}
+
+private:
+	std::unique_ptr<std::atomic<uint64_t>[]> slots;
+	size_t mask = 0;
+};
+
+/**
+ * Cache of pawn structure evaluation.
+ * See https://www.chessprogramming.org/Pawn_Hash_Table
+ * Pawn structure changes rarely so almost all probes hit.
+ * Unlike `TranspositionTable` every search thread owns its table.
+ */
+class PawnTable
+{
+public:
+	struct Entry
+	{
+		uint64_t key;
+		/* Pawn structure score from white's point of view */
+		ScorePair score;
+		/* Squares attacked by [white, black] pawns */
+		Bitboard attacks[2];
+		/* Squares that [white, black] pawns can attack when they advance */
+		Bitboard attackSpans[2];
+		/* Passed [white, black] pawns */
+		Bitboard passed[2];
+	};
+
+	/**
+	 * Number of [white, black] pawns scored by each `EvalWeights` term.
+	 */
+	struct Terms
+	{
+		byte doubled[2];
+		byte isolated[2];
+		byte backward[2];
+		/* [color] x [relative rank] */
+		byte passed[2][8];
+	};
+
+	explicit PawnTable(unsigned count = 16384)
+		: entries(std::make_unique<Entry[]>(count)), mask(count - 1)
+	{
+		KAREN_ASSERT((count & (count - 1)) == 0, "size of pawn table must be a power of two");
+		clear();
+	}
+
+	void clear() noexcept
+	{
+		for (size_t i = 0; i <= mask; i++)
+			entries[i] = Entry{};
+		/* Key of position without pawns is zero, make sure it isn't found by accident */
+		entries[0].key = 1;
+	}
+
+	/**
+	 * @return entry for pawn structure with hash `key` or nullptr if there's no such entry.
+	 */
+	[[nodiscard]]
+	const Entry* probe(uint64_t key) const noexcept
+	{
+		const Entry& entry = entries[key & mask];
+		return entry.key == key ? &entry : nullptr;
+	}
+
+	/**
+	 * @brief Evaluate pawn structure and store it in table.
+	 */
+	const Entry& store(uint64_t key, Bitboard whitePawns, Bitboard blackPawns) noexcept
+	{
+		Entry& entry = entries[key & mask];
+		entry.key = key;
+		evaluate(entry, whitePawns, blackPawns);
+		return entry;
+	}
+
+	/**
+	 * @return squares attacked by `pawns` of `color`.
+	 */
+	[[nodiscard]]
+	static constexpr Bitboard attacks(Bitboard pawns, Color color) noexcept
+	{
+		return (color == Color::WHITE) ?
+			((pawns & ~FILE_A) << 7) | ((pawns & ~FILE_H) << 9) :
+			((pawns & ~FILE_A) >> 9) | ((pawns & ~FILE_H) >> 7);
+	}
+
+	/**
+	 * @return squares in front of `bitboard` from `color`'s point of view.
+	 */
+	[[nodiscard]]
+	static constexpr Bitboard frontSpan(Bitboard bitboard, Color color) noexcept
+	{
+		if (color == Color::WHITE)
+		{
+			bitboard <<= 8;
+			bitboard |= bitboard << 8;
+			bitboard |= bitboard << 16;
+			bitboard |= bitboard << 32;
+		}
+		else
+		{
+			bitboard >>= 8;
+			bitboard |= bitboard >> 8;
+			bitboard |= bitboard >> 16;
+			bitboard |= bitboard >> 32;
+		}
+		return bitboard;
+	}
+
+private:
+	std::unique_ptr<Entry[]> entries;
+	size_t mask;
+
+	static void evaluate(Entry& entry, Bitboard whitePawns, Bitboard blackPawns) noexcept
+	{
+		const Terms terms = countTerms(entry, whitePawns, blackPawns);
+		entry.score = 0;
+		for (byte index = 0; index < 2; index++)
+		{
+			ScorePair score = terms.doubled[index] * evalWeights.doubledPawn +
+				terms.isolated[index] * evalWeights.isolatedPawn +
+				terms.backward[index] * evalWeights.backwardPawn;
+			for (byte rank = 0; rank < 8; rank++)
+				score += terms.passed[index][rank] * evalWeights.passedPawn[rank];
+			entry.score += index ? -score : score;
+		}
+	}
+
+public:
+	/**
+	 * @brief Find pawns scored by every term.
+	 * `entry` gets squares attacked by pawns and passed pawns.
+	 */
+	static Terms countTerms(Entry& entry, Bitboard whitePawns, Bitboard blackPawns) noexcept
+	{
+		Terms terms{};
+		for (Color color : { Color::WHITE, Color::BLACK })
+		{
+			const byte index = (color == Color::WHITE) ? 0 : 1;
+			const Bitboard ours = index ? blackPawns : whitePawns;
+			const Bitboard theirs = index ? whitePawns : blackPawns;
+			const Bitboard theirAttacks = attacks(theirs, !color);
+
+			entry.attacks[index] = attacks(ours, color);
+			entry.attackSpans[index] = attacks(ours | frontSpan(ours, color), color);
+			entry.passed[index] = 0;
+			for (Bitboard pawns = ours; pawns; pawns &= pawns - 1)
+			{
+				const Square square = firstSquare(pawns);
+				const byte x = getX(square), y = getY(square);
+				const Bitboard front = frontSpan(toBitboard(square), color);
+				const Bitboard stop = front & rankBitboard(index ? y - 1 : y + 1);
+				const Bitboard neighbours = ours & adjacentFiles(x);
+
+				if (ours & front)
+					terms.doubled[index]++;
+				if (!neighbours)
+					terms.isolated[index]++;
+				/* Every neighbour is in front and pawn can't advance safely */
+				else if (!(neighbours & ~frontSpan(rankBitboard(y), color)) && (theirAttacks & stop))
+					terms.backward[index]++;
+				if (!(ours & front) &&
+					!(theirs & (front | frontSpan(adjacentFiles(x) & rankBitboard(y), color))))
+				{
+					entry.passed[index] |= toBitboard(square);
+					terms.passed[index][index ? 7 - y : y]++;
+				}
+			}
+		}
+		return terms;
+	}
+};
+
+struct Figure
+{
+	Square pos;
+	Figure* pNext;
+};
+using FigureList = Figure*;
+
+/**
+ * @return number of king moves between `a` and `b`.
+ */
+[[nodiscard]]
+inline constexpr byte distance(Square a, Square b) noexcept
+{
+	const byte dx = getX(a) > getX(b) ? getX(a) - getX(b) : getX(b) - getX(a);
+	const byte dy = getY(a) > getY(b) ? getY(a) - getY(b) : getY(b) - getY(a);
+	return std::max(dx, dy);
+}
+
+/**
+ * @return material key of position where white has `whitePieces` and
+ * black has `blackPieces`, pieces are given by letters like "KBN".
+ */
+[[nodiscard]]
+inline constexpr uint64_t materialKey(std::string_view whitePieces, std::string_view blackPieces) noexcept
+{
+	constexpr std::string_view letters = " PNBRQK";
+	byte counts[16] = {};
+	uint64_t key = 0;
+	for (auto [pieces, color] : { std::pair{whitePieces, 8}, std::pair{blackPieces, 0} })
+		for (char letter : pieces)
+		{
+			const byte index = byte(letters.find(letter)) | color;
+			key ^= zobrist.material[index][counts[index]++];
+		}
+	return key;
+}
+
+/**
+ * Evaluates endgame with known material.
+ * @param strong figures of side that has more material, king first.
+ * @param weak figures of the other side, king first.
+ * @return score from `strong` side's point of view.
+ */
+using EndgameFunction = Score (*)(const Board& board, FigureList strong, FigureList weak);
+
+namespace endgame
+{
+	/* Score of position that is won with correct play */
+	inline constexpr Score KNOWN_WIN = 2000;
+
+	/**
+	 * @brief King and enough material to mate against lone king.
+	 * Weak king is pushed to the edge and strong king comes closer.
+	 */
+	inline Score KXK(const Board& board, FigureList strong, FigureList weak) noexcept
+	{
+		constexpr Score values[] = {
+			ZERO, PAWN_SCORE, KNIGHT_SCORE, BISHOP_SCORE, ROOK_SCORE, QUEEN_SCORE, ZERO, ZERO
+		};
+		const Square weakKing = weak->pos;
+		const byte x = getX(weakKing), y = getY(weakKing);
+		const byte edge = std::min<byte>(std::min<byte>(x, 7 - x), std::min<byte>(y, 7 - y));
+		Score score = KNOWN_WIN;
+		for (auto node = strong; node; node = node->pNext)
+			score += values[toByte(get<Code>(board[node->pos]))];
+		score += (3 - edge) * 40;
+		score += (7 - distance(strong->pos, weakKing)) * 20;
+		return score;
+	}
+
+	/**
+	 * @brief King, bishop and knight against lone king.
+	 * Weak king must be mated in a corner of bishop's color.
+	 */
+	inline Score KBNK(const Board& board, FigureList strong, FigureList weak) noexcept
+	{
+		Square bishop = strong->pos;
+		for (auto node = strong; node; node = node->pNext)
+			if (isBishop(board[node->pos]))
+				bishop = node->pos;
+		Square weakKing = weak->pos;
+		/* A1 and H8 are dark squares, mirror board for light-squared bishop */
+		if ((getX(bishop) + getY(bishop)) & 1)
+			weakKing = makeSquare(7 - getX(weakKing), getY(weakKing));
+		const byte corner = std::min(distance(weakKing, Square::A1), distance(weakKing, Square::H8));
+		Score score = KNOWN_WIN + KNIGHT_SCORE + BISHOP_SCORE;
+		score += (7 - corner) * 40;
+		score += (7 - distance(strong->pos, weak->pos)) * 20;
+		return score;
+	}
+}
+
+/**
+ * Cache of evaluation terms that depend only on material.
+ * See https://www.chessprogramming.org/Material_Hash_Table
+ * Every search thread owns its table.
+ */
+class MaterialTable
+{
+public:
+	struct Entry
+	{
+		uint64_t key;
+		/* Bishop pair, pawnless and knight-pawn terms from white's point of view */
+		ScorePair imbalance;
+		/* [white, black]: score is multiplied by `scale / normal_scale` when side is winning */
+		byte scale[2];
+		/* Neither side can win, search may return draw immediately */
+		bool draw;
+		/* Side that `endgame` is evaluated for */
+		Color strongSide;
+		/* Specialised evaluation or nullptr */
+		EndgameFunction endgame;
+	};
+
+	/**
+	 * [white, black] values of imbalance `EvalWeights` terms.
+	 */
+	struct Terms
+	{
+		byte bishopPair[2];
+		byte noPawns[2];
+		byte knightPawns[2];
+	};
+
+	static constexpr byte normal_scale = 64;
+
+	explicit MaterialTable(unsigned count = 4096)
+		: entries(std::make_unique<Entry[]>(count)), mask(count - 1)
+	{
+		KAREN_ASSERT((count & (count - 1)) == 0, "size of material table must be a power of two");
+		clear();
+	}
+
+	void clear() noexcept
+	{
+		for (size_t i = 0; i <= mask; i++)
+			entries[i] = Entry{};
+		/* Key of two bare kings is not zero, but make sure empty entries never match */
+		for (size_t i = 0; i <= mask; i++)
+			entries[i].key = ~uint64_t(0);
+	}
+
+	/**
+	 * @return entry for material with key `key` or nullptr if there's no such entry.
+	 */
+	[[nodiscard]]
+	const Entry* probe(uint64_t key) const noexcept
+	{
+		const Entry& entry = entries[key & mask];
+		return entry.key == key ? &entry : nullptr;
+	}
+
+	/**
+	 * @brief Evaluate material and store it in table.
+	 * @param counts number of pieces indexed by `pieceIndex()`.
+	 */
+	const Entry& store(uint64_t key, const byte counts[16]) noexcept
+	{
+		Entry& entry = entries[key & mask];
+		entry.key = key;
+		evaluate(entry, counts);
+		return entry;
+	}
+
+private:
+	std::unique_ptr<Entry[]> entries;
+	size_t mask;
+
+	struct Endgame
+	{
+		uint64_t key;
+		Color strongSide;
+		EndgameFunction evaluate;
+	};
+
+	/* Endgames recognized by material signature */
+	static constexpr Endgame endgames[] = {
+		{ materialKey("KBN", "K"), Color::WHITE, endgame::KBNK },
+		{ materialKey("K", "KBN"), Color::BLACK, endgame::KBNK },
+	};
+
+	static void evaluate(Entry& entry, const byte counts[16]) noexcept
+	{
+		const auto count = [counts](Color color, Code code) noexcept -> Score {
+			return counts[toByte(code) | ((color == Color::WHITE) ? 8 : 0)];
+		};
+		Score nonPawnMaterial[2];
+
+		const Terms terms = countTerms(counts);
+		entry.imbalance = 0;
+		for (Color color : { Color::WHITE, Color::BLACK })
+		{
+			const byte index = (color == Color::WHITE) ? 0 : 1;
+			const ScorePair imbalance = terms.bishopPair[index] * evalWeights.bishopPair +
+				terms.noPawns[index] * evalWeights.noPawns +
+				terms.knightPawns[index] * evalWeights.knightPawn;
+			entry.imbalance += index ? -imbalance : imbalance;
+
+			nonPawnMaterial[color == Color::WHITE ? 0 : 1] =
+				count(color, Code::KNIGHT) * KNIGHT_SCORE +
+				count(color, Code::BISHOP) * BISHOP_SCORE +
+				count(color, Code::ROOK) * ROOK_SCORE +
+				count(color, Code::QUEEN) * QUEEN_SCORE;
+		}
+
+		entry.endgame = nullptr;
+		entry.strongSide = Color::WHITE;
+		for (Color color : { Color::WHITE, Color::BLACK })
+		{
+			const byte us = (color == Color::WHITE) ? 0 : 1;
+			const Score ours = nonPawnMaterial[us], theirs = nonPawnMaterial[us ^ 1];
+			byte& scale = entry.scale[us];
+
+			scale = normal_scale;
+			/* Without pawns it's hard to win having less than a rook more */
+			if (count(color, Code::PAWN) == 0 && ours - theirs <= BISHOP_SCORE)
+				scale = (ours < ROOK_SCORE) ? 0 : (theirs <= BISHOP_SCORE ? 4 : 14);
+			/* Two knights can't force mate */
+			if (count(color, Code::PAWN) == 0 && ours == 2 * KNIGHT_SCORE && count(color, Code::KNIGHT) == 2)
+				scale = 0;
+
+			if (scale != 0 && ours >= ROOK_SCORE &&
+				theirs == 0 && count(!color, Code::PAWN) == 0)
+			{
+				entry.endgame = endgame::KXK;
+				entry.strongSide = color;
+			}
+		}
+		entry.draw = entry.scale[0] == 0 && entry.scale[1] == 0;
+
+		for (const auto& endgame : endgames)
+			if (endgame.key == entry.key)
+			{
+				entry.endgame = endgame.evaluate;
+				entry.strongSide = endgame.strongSide;
+			}
+	}
+
+public:
+	/**
+	 * @brief Find values of imbalance terms.
+	 * @param counts number of pieces indexed by `pieceIndex()`.
+	 */
+	static Terms countTerms(const byte counts[16]) noexcept
+	{
+		Terms terms{};
+		for (byte index = 0; index < 2; index++)
+		{
+			const auto count = [counts, index](Code code) noexcept -> byte {
+				return counts[toByte(code) | (index ? 0 : 8)];
+			};
+			/* Bonus for the bishop pair */
+			terms.bishopPair[index] = count(Code::BISHOP) > 1;
+			/* Penalty for having no pawns, as it makes it more difficult to win the endgame */
+			terms.noPawns[index] = count(Code::PAWN) == 0;
+			/* Knights lose value as pawns disappear. */
+			terms.knightPawns[index] = count(Code::KNIGHT) * count(Code::PAWN);
+		}
+		return terms;
+	}
+};
+
+/**
+ * Efficiently updatable neural network, alternative to hand-written evaluation.
+ * See https://www.chessprogramming.org/NNUE
+ * Inputs are pieces on squares seen by both sides. The first layer is kept
+ * in `Accumulator` and updated only for pieces that appeared or disappeared.
+ * Weights are read by `load()`, file layout is (little endian):
+ *  "KNN1", uint32 hidden size(must be `hidden_size`),
+ *  int16 feature weights[feature_count][hidden_size], int16 feature biases[hidden_size],
+ *  int16 output weights[2][hidden_size](side to move first), int32 output bias.
+ * Score is (output weights * clamp(accumulator, 0, activation_max) + output bias) *
+ * `output_scale` / (`activation_max` * `weight_scale`).
+ */
+class Network
+{
+public:
+	static constexpr unsigned feature_count = 768;
+	static constexpr unsigned hidden_size = 128;
+	static constexpr int activation_max = 127;
+	static constexpr int weight_scale = 64;
+	static constexpr int output_scale = 400;
+
+	struct alignas(32) Accumulator
+	{
+		/* [white's, black's point of view] */
+		int16_t values[2][hidden_size];
+	};
+
+	/**
+	 * @brief Read network from file at `path`.
+	 * @throw std::runtime_error if file can't be read or has wrong format.
+	 */
+	[[nodiscard]]
+	static std::unique_ptr<Network> load(const std::string& path)
+	{
+		std::ifstream file(path, std::ios::binary);
+		if (!file)
+			throw std::runtime_error("Network::load: can't open '" + path + "'");
+		char magic[4];
+		uint32_t hidden = 0;
+		file.read(magic, sizeof(magic));
+		file.read(reinterpret_cast<char*>(&hidden), sizeof(hidden));
+		if (!file || std::string_view(magic, 4) != "KNN1" || hidden != hidden_size)
+			throw std::runtime_error("Network::load: '" + path + "' isn't a network file");
+		auto network = std::unique_ptr<Network>(new Network());
+		file.read(reinterpret_cast<char*>(network->featureWeights), sizeof(network->featureWeights));
+		file.read(reinterpret_cast<char*>(network->featureBiases), sizeof(network->featureBiases));
+		file.read(reinterpret_cast<char*>(network->outputWeights), sizeof(network->outputWeights));
+		file.read(reinterpret_cast<char*>(&network->outputBias), sizeof(network->outputBias));
+		if (!file)
+			throw std::runtime_error("Network::load: '" + path + "' is truncated");
+		return network;
+	}
+
+	/**
+	 * @brief Reset `accumulator` to state of empty board.
+	 */
+	void clear(Accumulator& accumulator) const noexcept
+	{
+		std::copy(std::begin(featureBiases), std::end(featureBiases), accumulator.values[0]);
+		std::copy(std::begin(featureBiases), std::end(featureBiases), accumulator.values[1]);
+	}
+
+	/**
+	 * @brief Update `accumulator` when `piece` is placed at `square`.
+	 */
+	void addPiece(Accumulator& accumulator, Piece piece, Square square) const noexcept
+	{
+		kernels.addWeights(accumulator.values[0], featureWeights[feature(piece, square, Color::WHITE)], hidden_size);
+		kernels.addWeights(accumulator.values[1], featureWeights[feature(piece, square, Color::BLACK)], hidden_size);
+	}
+
+	/**
+	 * @brief Update `accumulator` when `piece` is removed from `square`.
+	 */
+	void removePiece(Accumulator& accumulator, Piece piece, Square square) const noexcept
+	{
+		kernels.subWeights(accumulator.values[0], featureWeights[feature(piece, square, Color::WHITE)], hidden_size);
+		kernels.subWeights(accumulator.values[1], featureWeights[feature(piece, square, Color::BLACK)], hidden_size);
+	}
+
+	/**
+	 * @return score from `side`'s point of view.
+	 */
+	[[nodiscard]]
+	Score evaluate(const Accumulator& accumulator, Color side) const noexcept
+	{
+		const byte us = (side == Color::WHITE) ? 0 : 1;
+		const int64_t output = int64_t(outputBias) +
+			kernels.clippedDot(accumulator.values[us], outputWeights[0], hidden_size, activation_max) +
+			kernels.clippedDot(accumulator.values[us ^ 1], outputWeights[1], hidden_size, activation_max);
+		return Score(output * output_scale / (activation_max * weight_scale));
+	}
+
+	/**
+	 * @return index of input feature for `piece` at `square` seen by `perspective`.
+	 */
+	[[nodiscard]]
+	static constexpr unsigned feature(Piece piece, Square square, Color perspective) noexcept
+	{
+		const unsigned own = get<Color>(piece) == perspective ? 0 : 1;
+		const unsigned position = (perspective == Color::WHITE) ? toByte(square) : toByte(square) ^ 56;
+		return ((own * 6) + toByte(get<Code>(piece)) - 1) * 64 + position;
+	}
+
+private:
+	alignas(32) int16_t featureWeights[feature_count][hidden_size];
+	alignas(32) int16_t featureBiases[hidden_size];
+	alignas(32) int16_t outputWeights[2][hidden_size];
+	int32_t outputBias;
+
+	Network() = default;
+};
+
+struct MoveEx
+{
+	int16_t score;
+	Move move;
+	
+	bool operator< (MoveEx rhs) const noexcept
+	{
+		return score < rhs.score;
+	}
+
+	bool operator> (MoveEx rhs) const noexcept
+	{
+		return score > rhs.score;
+	}
+};
+
+/**
+ * Almost same to `std::vector` but uses stack memory.
+ * Therefore it has constexpr capacity = `C`.
+ */
+template<typename T, unsigned C = 256>
+class VectorOnStack
+{
+public:
+	using size_type = unsigned int;
+	using iterator = T*;
+	using const_iterator = const T*;
+	
+	static constexpr size_type capacity = C;
+	
+private:
+	byte bytes[capacity * sizeof(T)];
+	T* data;
+	size_type sz;
+
+public:
+	VectorOnStack() noexcept : data(reinterpret_cast<T*>(bytes)), sz(0) {}
+	VectorOnStack(size_type size) noexcept : VectorOnStack()
+	{
+		if constexpr (!std::is_trivially_default_constructible_v<T>)
+						 while (sz < size)
+							 new(&data[sz]) T();
+	}
+	VectorOnStack(const VectorOnStack& other) : VectorOnStack()
+	{
+		for (const auto& elem : other)
+			push_back(elem);
+	}
+	VectorOnStack(VectorOnStack&& other) : VectorOnStack()
+	{
+		for (auto& elem : other)
+			push_back(std::move(elem));
+	}
+	VectorOnStack& operator=(const VectorOnStack& other)
+	{
+		if (this != &other)
+		{
+			clear();
+			for (const auto& elem : other)
+				push_back(elem);
+		}
+		return *this;
+	}
+	~VectorOnStack() noexcept
+	{
+		if constexpr (!std::is_trivially_destructible_v<T>)
+					 {
+						 for (auto& elem : *this)
+							 elem.~T();
+					 }
+	}
+
+	iterator begin() noexcept { return data; }
+	iterator end() noexcept { return data + sz; }
+	const_iterator begin() const noexcept { return data; }
+	const_iterator end() const noexcept { return data + sz; }
+	size_type size() const noexcept { return sz; }
+
+	/**
+	 * Get element of vector at `index`.
+	 * Warning: this function doesn't do checking for performance: if
+	 * `index >= size` then stack corruption will occur.
+	 */
+	T& operator[](size_type index) noexcept { return data[index]; }
+	/**
+	 * Get const element of vector at `index`.
+	 * Warning: this function doesn't do checking for performance: if
+	 * `index >= size` then stack corruption will occur.
+	 */
+	const T& operator[](size_type index) const noexcept { return data[index]; }
+
+	void push_back(T&& rvalue)
+	{
+		KAREN_ASSERT(sz < capacity, "vector on stack : size is maximum");
+		new(&data[sz++]) T(std::move(rvalue));
+	}
+	
+	void push_back(const T& lvalue)
+	{
+		KAREN_ASSERT(sz < capacity, "vector on stack : size is maximum");
+		new(&data[sz++]) T(lvalue);
+	}
+
+	void clear() noexcept
+	{
+		if constexpr (!std::is_trivially_destructible_v<T>)
+					 {
+						 for (auto& elem : *this)
+							 elem.~T();
+					 }
+		sz = 0;
+	}
+
+	void pop_back()
+	{
+		KAREN_ASSERT(sz > 0, "vector on stack : size is 0");
+		data[sz].~T();
+		sz--;
+	}
+
+	/**
+	 * @brief Erase element from vector at `pos`.
+	 * Complexity: O(N)
+	 * @return iterator that points to new element at `pos`.
+	 */
+	iterator erase(iterator pos)
+	{
+		KAREN_ASSERT(pos >= begin() && pos < end(),
+					 "VectorOnStack: passed iterator out of range [ begin(), end() )");
+		/* Call mecmpy when possible */
+		if constexpr (std::is_trivially_move_assignable_v<T>)
+						 std::memcpy(pos, pos + 1, (sz - (pos - data) - 1) * sizeof(T));
+		else
+		{
+			auto it = pos;
+			while (it != end() - 1)
+				*it = std::move(*++it);
+		}
+		sz--;
+		end()->~T(); /* Calling last element's destructor */
+		return pos;
+	}
+    /**
+	 * Erase element from vector at `index`.
+	 * Complexity: O(N)
+	 */
+	iterator erase(size_type index)
+	{
+		return erase(begin() + index);
+	}
+};
+
+/**
+ * Level of `KAREN_INSTRUMENTATION`, every level includes previous ones.
+ */
+enum class Instrumentation { NONE, COUNTERS, TRACING };
+
+inline constexpr Instrumentation instrumentation = static_cast<Instrumentation>(KAREN_INSTRUMENTATION);
+static_assert(instrumentation >= Instrumentation::NONE && instrumentation <= Instrumentation::TRACING,
+			  "KAREN_INSTRUMENTATION must be 0, 1 or 2");
+
+/**
+ * Counter that counts nothing, it's used instead of `uint64_t` when
+ * counters are disabled so increments compile to nothing.
+ */
+struct NoCounter
+{
+	constexpr NoCounter(uint64_t = 0) noexcept {}
+	constexpr NoCounter& operator++() noexcept { return *this; }
+	constexpr NoCounter operator++(int) noexcept { return *this; }
+	constexpr NoCounter& operator+=(uint64_t) noexcept { return *this; }
+	constexpr operator uint64_t() const noexcept { return 0; }
+};
+
+using Counter = std::conditional_t<instrumentation >= Instrumentation::COUNTERS, uint64_t, NoCounter>;
+
+/**
+ * What happened in a trace event, see `TraceBuffer`.
+ */
+enum class TraceEvent : byte
+{
+	/* Karen started and finished thinking on her move, value is number of half move */
+	THINK_BEGIN,
+	THINK_END,
+	/* Value is depth */
+	ITERATION_BEGIN,
+	ITERATION_END,
+	/* Best move differs from the previous iteration's one */
+	BEST_MOVE_CHANGE,
+	/* Search of a root move started, value is depth */
+	ROOT_MOVE_BEGIN,
+	/* Search of a root move finished with score below best score
+	 * found so far(fail low) or above it(fail high) */
+	ROOT_MOVE_FAIL_LOW,
+	ROOT_MOVE_FAIL_HIGH,
+};
+
+/**
+ * Ring buffer of trace events written by one thread.
+ * When it's full the oldest events are overwritten. Events are packed in
+ * two atomic words guarded by sequence number of the slot(like seqlock) so
+ * other threads may read buffer while it's written, `read()` drops events
+ * that were being written or overwritten during reading.
+ */
+class TraceBuffer
+{
+public:
+	static constexpr size_t capacity = 1 << 14;
+
+	struct Event
+	{
+		/* Nanoseconds of `std::chrono::steady_clock` */
+		uint64_t time;
+		TraceEvent type;
+		uint16_t value;
+		Move move;
+		/* Only 24 bits are stored */
+		int32_t score;
+	};
+
+	/**
+	 * @brief Record event, must be called by one thread only.
+	 */
+	void record(TraceEvent type, unsigned value, Move move, int32_t score) noexcept
+	{
+		const uint64_t time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+		const uint64_t data = uint64_t(type) | (uint64_t(value & 0xFFFF) << 8) |
+			(uint64_t(static_cast<uint16_t>(move)) << 24) | (uint64_t(uint32_t(score) & 0xFFFFFF) << 40);
+		const uint64_t index = head.load(std::memory_order_relaxed);
+		auto& slot = slots[index & (capacity - 1)];
+		/* Odd sequence number marks slot that is being written */
+		slot.sequence.store(2 * index + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		slot.time.store(time, std::memory_order_relaxed);
+		slot.data.store(data, std::memory_order_relaxed);
+		slot.sequence.store(2 * index + 2, std::memory_order_release);
+		head.store(index + 1, std::memory_order_release);
+	}
+
+	/**
+	 * @return recorded events from the oldest to the newest.
+	 */
+	[[nodiscard]]
+	std::vector<Event> read() const
+	{
+		const uint64_t end = head.load(std::memory_order_acquire);
+		const uint64_t begin = end > capacity ? end - capacity : 0;
+		std::vector<Event> events;
+		events.reserve(end - begin);
+		for (uint64_t i = begin; i < end; i++)
+		{
+			const auto& slot = slots[i & (capacity - 1)];
+			const uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+			const uint64_t time = slot.time.load(std::memory_order_relaxed);
+			const uint64_t data = slot.data.load(std::memory_order_relaxed);
+			/* Writer could overwrite the oldest events while they were read,
+			 * event is kept only if its slot wasn't touched during reading */
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (sequence != 2 * i + 2 || slot.sequence.load(std::memory_order_relaxed) != sequence)
+				continue;
+			events.push_back({
+					time, TraceEvent(data & 0xFF), uint16_t(data >> 8),
+					Move(uint16_t(data >> 24)), int32_t(uint32_t(data >> 40) << 8) >> 8 });
+		}
+		return events;
+	}
+
+	void clear() noexcept
+	{
+		head.store(0, std::memory_order_release);
+	}
+
+private:
+	struct Slot
+	{
+		/* 2 * index + 2 of event in the slot, odd while it's written */
+		std::atomic<uint64_t> sequence{0};
+		std::atomic<uint64_t> time{0};
+		std::atomic<uint64_t> data{0};
+	};
+	Slot slots[capacity];
+	std::atomic<uint64_t> head{0};
+};
+
+/**
+ * Histogram of values with bounded relative error, like HdrHistogram.
+ * See http://hdrhistogram.org
+ * Values are grouped by their highest bit and every group is split into
+ * 2^`precision_bits` buckets, so percentiles are within 1% of exact ones.
+ * Recording is constant time and doesn't allocate.
+ */
+class Histogram
+{
+public:
+	static constexpr unsigned precision_bits = 7;
+
+	Histogram()
+		: counts((65 - precision_bits) << precision_bits) {}
+
+	void record(uint64_t value) noexcept
+	{
+		counts[bucket(value)]++;
+		total++;
+		sum += value;
+		maximum = std::max(maximum, value);
+	}
+
+	[[nodiscard]]
+	uint64_t count() const noexcept { return total; }
+	[[nodiscard]]
+	uint64_t max() const noexcept { return maximum; }
+	[[nodiscard]]
+	double mean() const noexcept { return total ? double(sum) / total : 0.0; }
+
+	/**
+	 * @return value that `percent` percents of recorded values don't exceed, zero if histogram is empty.
+	 */
+	[[nodiscard]]
+	uint64_t percentile(double percent) const noexcept
+	{
+		if (total == 0)
+			return 0;
+		const uint64_t rank = std::clamp<uint64_t>(uint64_t(std::ceil(percent / 100 * total)), 1, total);
+		uint64_t seen = 0;
+		for (size_t i = 0; i < counts.size(); i++)
+		{
+			seen += counts[i];
+			if (seen >= rank)
+				return std::min(highest(unsigned(i)), maximum);
+		}
+		return maximum;
+	}
+
+	Histogram& operator+=(const Histogram& other) noexcept
+	{
+		for (size_t i = 0; i < counts.size(); i++)
+			counts[i] += other.counts[i];
+		total += other.total;
+		sum += other.sum;
+		maximum = std::max(maximum, other.maximum);
+		return *this;
+	}
+
+	void clear() noexcept
+	{
+		std::fill(counts.begin(), counts.end(), 0);
+		total = sum = maximum = 0;
+	}
+
+private:
+	/* Values below 2^(`precision_bits` + 1) have their own buckets, bigger ones
+	 * are shifted right so they have `precision_bits` bits after the highest one */
+	[[nodiscard]]
+	static unsigned bucket(uint64_t value) noexcept
+	{
+		unsigned highestBit = 0;
+		while (highestBit < 63 && (value >> (highestBit + 1)))
+			highestBit++;
+		if (highestBit <= precision_bits)
+			return unsigned(value);
+		const unsigned shift = highestBit - precision_bits;
+		return (shift << precision_bits) + unsigned(value >> shift);
+	}
+
+	/**
+	 * @return the biggest value of bucket.
+	 */
+	[[nodiscard]]
+	static uint64_t highest(unsigned index) noexcept
+	{
+		if (index < (2u << precision_bits))
+			return index;
+		const unsigned shift = (index >> precision_bits) - 1;
+		const uint64_t lowest = uint64_t(index - (shift << precision_bits)) << shift;
+		return lowest + (uint64_t(1) << shift) - 1;
+	}
+
+	std::vector<uint64_t> counts;
+	uint64_t total = 0;
+	uint64_t sum = 0;
+	uint64_t maximum = 0;
+};
+
+/**
+ * Set of worker threads that live as long as the pool does.
+ * `Engine` keeps one so that starting a search doesn't spawn threads.
+ * When `KAREN_ENABLE_PARALLEL` is not defined pool has no threads and
+ * tasks are executed immediately by `submit()`.
+ */
+class ThreadPool
+{
+public:
+	ThreadPool() = default;
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+	~ThreadPool() noexcept
+	{
+#ifdef KAREN_ENABLE_PARALLEL
+		{
+			std::lock_guard lock(mutex);
+			quit = true;
+		}
+		condition.notify_all();
+		for (auto& thread : threads)
+			thread.join();
+#endif
+	}
+
+	/**
+	 * @return number of worker threads.
+	 */
+	[[nodiscard]]
+	unsigned size() const noexcept
+	{
+#ifdef KAREN_ENABLE_PARALLEL
+		return threads.size();
+#else
+		return 0;
+#endif
+	}
+
+	/**
+	 * @brief Make pool have at least `count` worker threads.
+	 * Threads are never destroyed before the pool is.
+	 */
+	void reserve([[maybe_unused]] unsigned count)
+	{
+#ifdef KAREN_ENABLE_PARALLEL
+		while (threads.size() < count)
+			threads.emplace_back([this] { loop(); });
+#endif
+	}
+
+	/**
+	 * @brief Run `task` on one of the worker threads.
+	 * @return future that will hold result of `task`.
+	 */
+	template<typename F>
+	[[nodiscard]]
+	std::future<std::invoke_result_t<F>> submit(F&& task)
+	{
+		using R = std::invoke_result_t<F>;
+		auto packaged = std::make_shared<std::packaged_task<R()>>(std::forward<F>(task));
+		auto future = packaged->get_future();
+#ifdef KAREN_ENABLE_PARALLEL
+		{
+			std::lock_guard lock(mutex);
+			tasks.emplace_back([packaged] { (*packaged)(); });
+		}
+		condition.notify_one();
+#else
+		(*packaged)();
+#endif
+		return future;
+	}
+
+private:
+#ifdef KAREN_ENABLE_PARALLEL
+	std::vector<std::thread> threads;
+	std::deque<std::function<void()>> tasks;
+	std::mutex mutex;
+	std::condition_variable condition;
+	bool quit = false;
+
+	void loop()
+	{
+		while (true)
+		{
+			std::function<void()> task;
+			{
+				std::unique_lock lock(mutex);
+				condition.wait(lock, [this] { return quit || !tasks.empty(); });
+				if (quit && tasks.empty())
+					return;
+				task = std::move(tasks.front());
+				tasks.pop_front();
+			}
+			task();
+		}
+	}
+#endif
+};
+
+/**
+ * The main chess engine class.
+ */
+class Engine
+{
+public:
+	/**
+	 * Counters of one search, every thread has its own ones.
+	 * Nodes are classified by their result: PV nodes return score inside
+	 * the window, cut nodes fail high and all nodes fail low. Nodes that
+	 * returned before searching moves(hash or null move cutoffs, stand pat)
+	 * aren't classified.
+	 * See https://www.chessprogramming.org/Node_Types
+	 */
+	struct SearchStats
+	{
+		Counter pvNodes = 0;
+		Counter cutNodes = 0;
+		Counter allNodes = 0;
+		/* Nodes where only captures are searched */
+		Counter quiescenceNodes = 0;
+		Counter nullMoveTries = 0;
+		Counter nullMoveCutoffs = 0;
+		Counter betaCutoffs = 0;
+		/* Beta cutoffs caused by the first searched move, high ratio means good move ordering */
+		Counter firstMoveCutoffs = 0;
+		Counter ttProbes = 0;
+		Counter ttHits = 0;
+		/* Hits with enough depth to return score without search */
+		Counter ttCutoffs = 0;
+		/* Maximum ply reached */
+		Counter selDepth = 0;
+
+		SearchStats& operator+=(const SearchStats& other) noexcept
+		{
+			pvNodes += other.pvNodes;
+			cutNodes += other.cutNodes;
+			allNodes += other.allNodes;
+			quiescenceNodes += other.quiescenceNodes;
+			nullMoveTries += other.nullMoveTries;
+			nullMoveCutoffs += other.nullMoveCutoffs;
+			betaCutoffs += other.betaCutoffs;
+			firstMoveCutoffs += other.firstMoveCutoffs;
+			ttProbes += other.ttProbes;
+			ttHits += other.ttHits;
+			ttCutoffs += other.ttCutoffs;
+			selDepth = std::max<uint64_t>(selDepth, other.selDepth);
+			return *this;
+		}
+	};
+
+	/**
+	 * Completed iteration of iterative deepening, recorded when
+	 * instrumentation is `Instrumentation::TRACING`.
+	 */
+	struct Iteration
+	{
+		int depth;
+		/* Time since search started */
+		std::chrono::milliseconds time;
+		/* Nodes searched since search started, counted every few thousands nodes */
+		uint64_t nodes;
+		Move move;
+		Score score;
+	};
+
+	struct ThinkInfo
+	{
+		std::chrono::milliseconds time;
+		/* Time engine was allowed to think, zero when there was no time limit */
+		std::chrono::milliseconds budget{0};
+		/* false if search took more time than it was allowed */
+		bool budgetMet = true;
+		/* Depth of the last completed iteration */
+		int depth = 0;
+		Counter positionsEvaluated = 0;
+		Counter positionsTransfered = 0;
+		/* Evaluations taken from eval cache */
+		Counter evalCacheHits = 0;
+		/* Estimated time that computing evaluations found in cache would take */
+		std::chrono::microseconds evalTimeSaved{0};
+		/* Transposition table stores that raced with another thread's store */
+		Counter ttWriteConflicts = 0;
+		/* Times a thread waited for another one to publish its root move */
+		Counter lockWaits = 0;
+		SearchStats stats;
+	};
+
+	/**
+	 * Conditions that tell `think()` when to stop.
+	 * Time limits equal to zero are ignored.
+	 */
+	struct Limits
+	{
+		/* Maximum depth of the search */
+		int depth = 7;
+		/* Number of threads that will search simultaneously */
+		unsigned threads = 1;
+		/* Time left on the clock of side to move */
+		std::chrono::milliseconds time{0};
+		/* Time added to the clock after every move */
+		std::chrono::milliseconds increment{0};
+		/* Moves left until time control, zero means rest of the game */
+		unsigned movesToGo = 0;
+		/* Exact time to think on this move */
+		std::chrono::milliseconds moveTime{0};
+		/* Search position after expected opponent's move, time limits
+		 * are ignored until `ponderhit()` is called */
+		bool ponder = false;
+		/* Number of best moves to find, see `analyze()` */
+		unsigned multiPV = 1;
+		/* Search is stopped after this number of nodes, zero means no limit */
+		uint64_t nodes = 0;
+		/* Result depends only on position and limits: search is done with
+		 * one thread, time limits are ignored and hash table is cleared */
+		bool deterministic = false;
+	};
+
+	/**
+	 * Line of analysis: root move, its score from the point of view
+	 * of side to move and expected continuation which starts with `move`.
+	 */
+	struct Line
+	{
+		Move move;
+		Score score;
+		std::vector<Move> pv;
+	};
+
+	struct MoveInfo
+	{
+		byte enPassantAvailable = 8;
+		Move move;
 		Figure* moved = nullptr;
 		Piece movedPiece;
 		Figure* erased = nullptr;
-		Piece erasedPiece;
+		Piece erasedPiece = Piece::EMPTY;
+		/* Hash of position before move */
+		uint64_t hash;
+		/* Pawn and material hashes of position before move */
+		uint64_t pawnHash;
+		uint64_t materialKey;
+		/* Material score and game phase of position before move */
+		ScorePair material;
+		byte phase;
 	};
 
-	static constexpr bool enable_think_info = true;
+	/* Counters of `ThinkInfo` are updated during search */
+	static constexpr bool enable_think_info = instrumentation >= Instrumentation::COUNTERS;
 
 	enum class GameState { PLAY, DRAW, MATE };
 	
+	/* Without counters(`Instrumentation::NONE`) fields of `ThinkInfo` are kept but its
+	 * counters are no-op `NoCounter`s that read as zero, only time, budget and depth are set */
 	struct State :
-		std::conditional_t<enable_think_info, ThinkInfo, DummyType>,
+		ThinkInfo,
 		MoveInfo
 	{
 		Color side;
 		GameState game;
 		bool isCheck;
 		unsigned halfMoveNo = 0;
+		/* Zobrist hash of position */
+		uint64_t hash = 0;
+		/* Zobrist hash of pawns only */
+		uint64_t pawnHash = 0;
+		/* Hash of piece counts, see `materialKey()` */
+		uint64_t materialKey = 0;
+		/* Sum of `pieceSquareScore()` of all pieces */
+		ScorePair material = 0;
+		/* Sum of `piecePhase()` of all pieces, `MIDDLEGAME_PHASE` at the start of game */
+		byte phase = 0;
+		/* Number of pieces of every kind, indexed by `pieceIndex()` */
+		byte pieceCount[16] = {};
 	};
 
 	static constexpr struct
@@ -933,7 +3318,244 @@ private:
 	/* Buffer for avoiding allocating memory on heap */
 	Figure figuresBuffer[64];
 
-	Engine(const Engine&) = default;
+	struct RootLine
+	{
+		Move move;
+		Score score;
+	};
+
+	/**
+	 * Data shared between threads during search.
+	 */
+	struct SearchControl
+	{
+		std::atomic<bool> stop = false;
+		/* Index of the next root move that will be taken by a thread */
+		std::atomic<unsigned> nextRootMove = 0;
+		/* Best score found at root, threads use it as their alpha */
+		std::atomic<Score> alpha = -INF * 2;
+		/* Search must be stopped after this time point */
+		std::atomic<std::chrono::steady_clock::time_point> deadline;
+		std::atomic<bool> hasDeadline = false;
+		/* Search ignores time until `ponderhit()` is called */
+		std::atomic<bool> pondering = false;
+		/* Nodes searched by all threads, counted in `poll()` */
+		std::atomic<uint64_t> nodes = 0;
+		uint64_t nodeLimit = 0;
+		/* Depth of the last completed iteration */
+		std::atomic<int> depth = 0;
+#ifdef KAREN_ENABLE_PARALLEL
+		std::mutex bestMutex;
+		/* Helper threads stay in `helpRoot()` for whole search and wait for root searches here */
+		std::mutex helperMutex;
+		std::condition_variable helperWake;
+		std::condition_variable helperDone;
+		/* Number of root searches given to helpers and depth of the last one */
+		unsigned helperJob = 0;
+		int helperDepth = 0;
+		/* Helpers which haven't left `helpRoot()` and which search the last root search */
+		unsigned helpersRunning = 0;
+		unsigned helpersBusy = 0;
+		bool helpersQuit = false;
+#endif
+		/* Result of the search */
+		std::atomic<Move> bestMove;
+		/* Best move of currently searched line and whether it was searched completely */
+		std::atomic<Move> lineMove;
+		std::atomic<bool> lineComplete = false;
+		/* Lines after the first one of multi-PV search are searched, set between
+		 * root searches. They store to `linesTable` and probe it before the main table */
+		bool laterLine = false;
+		TranspositionTable* linesTable = nullptr;
+		VectorOnStack<MoveEx, max_available_moves> rootMoves;
+		/* Lines found in the last completed iteration */
+		VectorOnStack<RootLine, max_available_moves> lines;
+		/* Stats of every thread, published in `poll()` so they can be read during search */
+		std::mutex statsMutex;
+		std::vector<SearchStats> threadStats;
+		/* Timeline of the search, guarded by `statsMutex` */
+		std::vector<Iteration> iterations;
+	};
+
+	/**
+	 * Decides how long engine may think on a move.
+	 * Soft limit is checked between iterations of iterative deepening:
+	 * it shrinks when best move is stable and grows when score drops.
+	 * Hard limit stops search immediately.
+	 */
+	class TimeManager
+	{
+	public:
+		using clock = std::chrono::steady_clock;
+		using milliseconds = std::chrono::milliseconds;
+
+		/* Time reserved for communication with user and other overhead */
+		static constexpr milliseconds move_overhead{30};
+		/* Number of moves we expect to play when number of moves to go is unknown */
+		static constexpr unsigned expected_moves = 30;
+		/* Score drop after which engine thinks longer */
+		static constexpr Score fail_low_margin = 30;
+
+		void start(const Limits& limits) noexcept
+		{
+			startTime = clock::now();
+			stability = 0;
+			failLow = false;
+			bestMove = makeMove(Square::A1, Square::A1);
+			if (limits.moveTime.count() > 0)
+			{
+				enabled = true;
+				hard = std::max(limits.moveTime - move_overhead, milliseconds(1));
+				soft = hard;
+			}
+			else if (limits.time.count() > 0)
+			{
+				enabled = true;
+				const milliseconds available = std::max(limits.time - move_overhead, milliseconds(1));
+				const unsigned movesToGo = limits.movesToGo ?
+					std::min(limits.movesToGo, expected_moves) : expected_moves;
+				hard = std::min(available * 8 / 10,
+								(available / movesToGo + limits.increment * 3 / 4) * 4);
+				hard = std::max(hard, milliseconds(1));
+				soft = std::min(available / movesToGo + limits.increment * 3 / 4, hard);
+			}
+			else
+			{
+				enabled = false;
+				soft = hard = milliseconds(0);
+			}
+		}
+
+		[[nodiscard]]
+		bool isEnabled() const noexcept { return enabled; }
+
+		/**
+		 * @brief Start counting time from now, limits are kept.
+		 * Can be called while search is running.
+		 */
+		void restart() noexcept
+		{
+			startTime = clock::now();
+		}
+
+		[[nodiscard]]
+		milliseconds elapsed() const noexcept
+		{
+			return std::chrono::duration_cast<milliseconds>(clock::now() - startTime.load());
+		}
+
+		[[nodiscard]]
+		milliseconds hardLimit() const noexcept { return hard; }
+
+		[[nodiscard]]
+		clock::time_point deadline() const noexcept { return startTime.load() + hard; }
+
+		/**
+		 * @brief Tell time manager about result of finished iteration.
+		 * @return true if next iteration must not be started.
+		 */
+		[[nodiscard]]
+		bool iterationDone(Move best, Score score) noexcept
+		{
+			if (best == bestMove)
+				stability++;
+			else
+				stability = 0;
+			if (bestMove != makeMove(Square::A1, Square::A1))
+				failLow = score + fail_low_margin < bestScore;
+			bestMove = best;
+			bestScore = score;
+
+			if (!enabled)
+				return false;
+			/* Stable best move needs less time, changing best move needs more */
+			double scale = (stability == 0) ? 1.3 : std::max(0.5, 1.0 - 0.15 * stability);
+			if (failLow)
+				scale *= 1.5;
+			const auto target = std::min(std::chrono::duration_cast<milliseconds>(soft * scale), hard);
+			/* Next iteration usually takes more time than all previous
+			 * ones together so don't start it when half of time is gone. */
+			return elapsed() * 2 > target;
+		}
+
+	private:
+		std::atomic<clock::time_point> startTime;
+		milliseconds soft{0};
+		milliseconds hard{0};
+		bool enabled = false;
+		bool failLow = false;
+		unsigned stability = 0;
+		Move bestMove;
+		Score bestScore = ZERO;
+	};
+
+	/* Threads that run search, created on first `startThink()` */
+	std::unique_ptr<ThreadPool> pool;
+	std::unique_ptr<SearchControl> control;
+	std::unique_ptr<TranspositionTable> table;
+	/* Table of multi-PV lines after the first one, created by the first multi-PV search */
+	std::unique_ptr<TranspositionTable> linesTable;
+	unsigned hashSize = 16;
+	std::unique_ptr<EvalCache> cache;
+	unsigned evalCacheSize = 256;
+	TimeManager timeManager;
+	/* Copies of this engine that threads search on */
+	std::vector<std::unique_ptr<Engine>> workers;
+	std::shared_future<Move> thinking;
+#ifdef KAREN_ENABLE_PARALLEL
+	/* Tasks of helper threads of current or last search */
+	std::vector<std::future<void>> helperTasks;
+#endif
+	/* Control of the search this engine participates in */
+	SearchControl* search = nullptr;
+	/* Transposition table of the search this engine participates in */
+	TranspositionTable* tt = nullptr;
+	/* Eval cache of the search this engine participates in */
+	EvalCache* evalCache = nullptr;
+	/* Evaluation is done by network when it's set */
+	std::shared_ptr<const Network> network;
+	/* First layer of `network` for every position since `setBoard()` */
+	std::vector<Network::Accumulator> accumulators;
+	/* Filled by `evaluate()` */
+	mutable PawnTable pawnTable;
+	mutable MaterialTable materialTable;
+	/* Used to estimate time saved by `evalCache` */
+	mutable struct
+	{
+		Counter hits;
+		Counter misses;
+		/* Time of every `eval_time_sample`th computed evaluation */
+		std::chrono::nanoseconds sampledTime;
+		unsigned samples;
+	} evalStats = {};
+	static constexpr unsigned eval_time_sample = 64;
+	/* Evaluation stops early when it's that far outside the window */
+	static constexpr Score lazy_margin = 200;
+	/* Search is stopped, all nodes must return immediately */
+	bool aborted = false;
+	/* Number of nodes left until `poll()` */
+	unsigned nodesUntilPoll = 0;
+	/* Number of nodes between the last two calls of `poll()` */
+	unsigned pollChunk = 0;
+	/* Index of this engine in `workers` of the searching engine */
+	unsigned threadIndex = 0;
+	/* `validate()` is called every that many `doMove()` and `undoMove()`, 0 disables it */
+	static constexpr unsigned validate_interval = KAREN_VALIDATE_INTERVAL;
+	/* Number of moves left until `validate()` */
+	unsigned movesUntilValidate = validate_interval;
+	/* Events of the thread that uses this engine, only with `Instrumentation::TRACING` */
+	std::unique_ptr<TraceBuffer> traceBuffer;
+	static constexpr bool enable_tracing = instrumentation >= Instrumentation::TRACING;
+
+	/* Only captures are searched starting from this ply */
+	static constexpr unsigned quiescence_ply = 7;
+	/* How often (in nodes) the stop flag is checked */
+	static constexpr unsigned poll_interval = 4096;
+
+	/**
+	 * @brief Create an empty engine that threads search on.
+	 */
+	Engine() = default;
 	
 public:
 	/**
@@ -946,6 +3568,19 @@ public:
 		state.isCheck = false;
 
 		fillLists();
+		computeIncremental();
+		if constexpr (enable_tracing)
+					 traceBuffer = std::make_unique<TraceBuffer>();
+	}
+
+	Engine(const Engine&) = delete;
+	Engine& operator=(const Engine&) = delete;
+
+	~Engine() noexcept
+	{
+		stop();
+		if (thinking.valid())
+			thinking.wait();
 	}
 
 	/**
@@ -963,6 +3598,16 @@ public:
 		state.isCheck = false;
 		
 		fillLists();
+		computeIncremental();
+	}
+
+	/**
+	 * @brief Set engine's board and side to move.
+	 */
+	void setBoard(const Board& board, Color side) noexcept
+	{
+		state.side = side;
+		setBoard(board);
 	}
 
 	/**
@@ -972,6 +3617,8 @@ public:
 	auto doMove(Move move)
 	{
 		MoveInfo info;
+		if (network)
+			accumulators.push_back(accumulators.back());
 
 		const auto type = get<MoveType>(move);
 		const auto from = getOrig(move);
@@ -979,6 +3626,11 @@ public:
 		info.move = move;
 		info.enPassantAvailable = state.enPassantAvailable;
 		info.erased = nullptr;
+		info.hash = state.hash;
+		info.pawnHash = state.pawnHash;
+		info.materialKey = state.materialKey;
+		info.material = state.material;
+		info.phase = state.phase;
 
 		[[maybe_unused]]
 		const byte x1 = getX(from), y1 = getY(from),
@@ -1011,6 +3663,8 @@ public:
 				info.moved = moving;
 				info.erasedPiece = board[to];
 				info.movedPiece = board[from];
+				takePiece(board[from], from);
+				takePiece(board[to], to);
 				
 				moving->pos = to;
 				if (isWhitePawn(board[from]) && getY(to) == 7) /* white promotion */
@@ -1023,6 +3677,7 @@ public:
 					makeMoved(board[to]);
 				}
 				board[from] = Piece::EMPTY;
+				putPiece(board[to], to);
 			}
 			break;
 			case MoveType::ENPASSANT:
@@ -1056,11 +3711,14 @@ public:
 				info.moved->pos = to;
 				info.movedPiece = board[from];
 				info.erasedPiece = board[felledPos];
+				takePiece(board[from], from);
+				takePiece(board[felledPos], felledPos);
 
 				board[to] = board[from];
 				board[from] = Piece::EMPTY;
 				board[felledPos] = Piece::EMPTY;
 				makeMoved(board[to]);
+				putPiece(board[to], to);
 
 				state.enPassantAvailable = 8;
 			}
@@ -1086,8 +3744,12 @@ public:
 				KAREN_ASSERT(!isMoved(rook),
 							 "doing castling after rook moved is not allowed");
 
+				takePiece(king, positions[0]);
+				takePiece(rook, positions[3]);
 				makeMoved(king);
 				makeMoved(rook);
+				putPiece(king, positions[2]);
+				putPiece(rook, positions[1]);
 
 				find(positions[0], state.side)->pos = positions[2];
 				find(positions[3], state.side)->pos = positions[1];
@@ -1123,8 +3785,12 @@ public:
 				KAREN_ASSERT(midL == Piece::EMPTY && midM == Piece::EMPTY && midR == Piece::EMPTY,
 							 "space between king and rook must be EMPTY");
 
+				takePiece(king, positions[4]);
+				takePiece(rook, positions[0]);
 				makeMoved(king);
 				makeMoved(rook);
+				putPiece(king, positions[2]);
+				putPiece(rook, positions[3]);
 
 				find(positions[0], state.side)->pos = positions[3];
 				find(positions[4], state.side)->pos = positions[2];
@@ -1143,7 +3809,10 @@ public:
 		}
 		state.side = !state.side;
 		state.halfMoveNo++;
-		
+		state.hash ^= zobrist.side ^
+			zobrist.enPassant[info.enPassantAvailable] ^
+			zobrist.enPassant[state.enPassantAvailable];
+		sampleValidate();
 		return info;
 	}
 
@@ -1151,8 +3820,10 @@ public:
 	 * @brief Undo a move.
 	 * @warning `info` must be value returned from `doMove()`.
 	 */
-	void undoMove(const MoveInfo& info) noexcept
+	void undoMove(const MoveInfo& info) noexcept(validate_interval == 0)
 	{
+		if (network)
+			accumulators.pop_back();
 		if (info.erased)
 		{
 			insert(info.erased, state.side);
@@ -1164,9 +3835,15 @@ public:
 		Square from = getOrig(info.move);
 		Square to = getDest(info.move);
 
+		if (info.erasedPiece != Piece::EMPTY)
+			state.pieceCount[pieceIndex(info.erasedPiece)]++;
+
 		switch (moveType)
 		{
 			case MoveType::NORMAL:
+				/* Piece at `to` differs from moved one after promotion */
+				state.pieceCount[pieceIndex(board[to])]--;
+				state.pieceCount[pieceIndex(info.movedPiece)]++;
 				info.moved->pos = from;
 				board[from] = info.movedPiece;
 				board[to] = info.erasedPiece;
@@ -1225,6 +3902,12 @@ public:
 		}
 		state.enPassantAvailable = info.enPassantAvailable;
 		state.halfMoveNo--;
+		state.hash = info.hash;
+		state.pawnHash = info.pawnHash;
+		state.materialKey = info.materialKey;
+		state.material = info.material;
+		state.phase = info.phase;
+		sampleValidate();
 	}
 
 	/**
@@ -1253,6 +3936,101 @@ public:
 	[[nodiscard]]
 	auto& getList(Color side) const noexcept { return (side == Color::WHITE) ? whiteList : blackList; }
 
+	/**
+	 * @brief Check that board, figure lists, en passant state and everything
+	 * `doMove()` updates incrementally agree with each other.
+	 * It's slow, `doMove()` and `undoMove()` call it every `KAREN_VALIDATE_INTERVAL` moves.
+	 * @throw karen11::Error describing the first inconsistency.
+	 */
+	void validate() const
+	{
+		const auto fail = [](const std::string& message) {
+			throw Error(message, __LINE__, "Engine::validate");
+		};
+		for (Color side : { Color::WHITE, Color::BLACK })
+		{
+			const char* name = (side == Color::WHITE) ? "white" : "black";
+			unsigned listed = 0, onBoard = 0;
+			for (auto node = getList(side); node; node = node->pNext)
+			{
+				if (++listed > 16)
+					fail(std::string(name) + " figure list has more than 16 nodes");
+				if (!isValid(node->pos))
+					fail(std::string(name) + " figure list has invalid square");
+				Piece piece = board[node->pos];
+				if (piece == Piece::EMPTY || get<Color>(piece) != side)
+					fail(std::string(name) + " figure at " + to_string(node->pos) + " isn't on board");
+				if (isKing(piece) != (node == getList(side)))
+					fail(std::string(name) + " king isn't first in figure list");
+			}
+			for (Square n = Square::A1; isValid(n); ++n)
+				onBoard += board[n] != Piece::EMPTY && get<Color>(board[n]) == side;
+			if (listed != onBoard)
+				fail(std::string(name) + " figure list has " + std::to_string(listed) +
+					 " nodes, board has " + std::to_string(onBoard) + " pieces");
+		}
+
+		const byte ep = state.enPassantAvailable;
+		if (ep > 8)
+			fail("invalid en passant file " + std::to_string(ep));
+		if (ep != 8)
+		{
+			/* Pawn of side that has just moved stands on its fourth rank
+			 * and squares it passed are empty */
+			const bool white = state.side == Color::WHITE;
+			const Piece pawn = board[makeSquare(ep, white ? 4 : 3)];
+			if (!(white ? isBlackPawn(pawn) : isWhitePawn(pawn)) ||
+				board[makeSquare(ep, white ? 5 : 2)] != Piece::EMPTY ||
+				board[makeSquare(ep, white ? 6 : 1)] != Piece::EMPTY)
+				fail("en passant is available on file " + std::to_string(ep) + " but no pawn has just moved there");
+		}
+
+		uint64_t hash = zobrist.enPassant[ep], pawnHash = 0, materialKey = 0;
+		if (state.side == Color::BLACK)
+			hash ^= zobrist.side;
+		ScorePair material = 0;
+		byte phase = 0;
+		byte pieceCount[16] = {};
+		for (Square n = Square::A1; isValid(n); ++n)
+		{
+			Piece piece = board[n];
+			if (piece == Piece::EMPTY)
+				continue;
+			hash ^= pieceKey(piece, n);
+			if (isPawn(piece))
+				pawnHash ^= pieceKey(piece, n);
+			material += pieceSquareScore(piece, n);
+			phase += piecePhase(piece);
+			materialKey ^= zobrist.material[pieceIndex(piece)][pieceCount[pieceIndex(piece)]++];
+		}
+		if (hash != state.hash)
+			fail("incremental hash is broken");
+		if (pawnHash != state.pawnHash)
+			fail("incremental pawn hash is broken");
+		if (materialKey != state.materialKey)
+			fail("incremental material key is broken");
+		if (!std::equal(std::begin(pieceCount), std::end(pieceCount), std::begin(state.pieceCount)))
+			fail("incremental piece counts are broken");
+		if (material != state.material || material != boardScore(board))
+			fail("incremental material score is broken");
+		if (phase != state.phase)
+			fail("incremental game phase is broken");
+
+		if (network)
+		{
+			if (accumulators.empty())
+				fail("network is set but there's no accumulator");
+			/* Search mustn't allocate, so it's on stack */
+			Network::Accumulator accumulator;
+			network->clear(accumulator);
+			for (Square n = Square::A1; isValid(n); ++n)
+				if (board[n] != Piece::EMPTY)
+					network->addPiece(accumulator, board[n], n);
+			if (std::memcmp(accumulator.values, accumulators.back().values, sizeof(accumulator.values)) != 0)
+				fail("incremental network accumulator is broken");
+		}
+	}
+
 private:
 	struct SquareEx { byte x, y; };
 	
@@ -1436,6 +4214,103 @@ private:
 		blackList = blackLists[5];
 	}
 
+	/**
+	 * @brief Compute hashes, material score, game phase and piece counts from scratch.
+	 */
+	void computeIncremental() noexcept
+	{
+		state.hash = zobrist.enPassant[state.enPassantAvailable];
+		if (state.side == Color::BLACK)
+			state.hash ^= zobrist.side;
+		state.pawnHash = 0;
+		state.materialKey = 0;
+		state.material = 0;
+		state.phase = 0;
+		std::fill(std::begin(state.pieceCount), std::end(state.pieceCount), 0);
+		accumulators.clear();
+		if (network)
+		{
+			accumulators.emplace_back();
+			network->clear(accumulators.back());
+		}
+		for (Square n = Square::A1; isValid(n); ++n)
+			putPiece(board[n], n);
+	}
+
+	/**
+	 * @brief Update hashes, material and piece counts when `piece` is placed at `square`.
+	 */
+	void putPiece(Piece piece, Square square) noexcept
+	{
+		if (piece == Piece::EMPTY)
+			return;
+		state.hash ^= pieceKey(piece, square);
+		if (isPawn(piece))
+			state.pawnHash ^= pieceKey(piece, square);
+		state.material += pieceSquareScore(piece, square);
+		state.phase += piecePhase(piece);
+		state.materialKey ^= zobrist.material[pieceIndex(piece)][state.pieceCount[pieceIndex(piece)]++];
+		if (network)
+			network->addPiece(accumulators.back(), piece, square);
+	}
+
+	/**
+	 * @brief Update hashes, material and piece counts when `piece` is removed from `square`.
+	 */
+	void takePiece(Piece piece, Square square) noexcept
+	{
+		if (piece == Piece::EMPTY)
+			return;
+		state.hash ^= pieceKey(piece, square);
+		if (isPawn(piece))
+			state.pawnHash ^= pieceKey(piece, square);
+		state.material -= pieceSquareScore(piece, square);
+		state.phase -= piecePhase(piece);
+		state.materialKey ^= zobrist.material[pieceIndex(piece)][--state.pieceCount[pieceIndex(piece)]];
+		if (network)
+			network->removePiece(accumulators.back(), piece, square);
+	}
+
+	/**
+	 * @brief Call `validate()` every `validate_interval`th time.
+	 */
+	void sampleValidate()
+	{
+		if constexpr (validate_interval > 0)
+			if (--movesUntilValidate == 0)
+			{
+				movesUntilValidate = validate_interval;
+				validate();
+			}
+	}
+
+	/**
+	 * @brief Make this engine's position same as `other`'s.
+	 * @detail Unlike `setBoard()` it keeps order of figures in lists
+	 * so search on copy behaves exactly like search on `other`.
+	 */
+	void copyPosition(const Engine& other)
+	{
+		const auto rebase = [&](const Figure* node) noexcept -> Figure* {
+			return node ? figuresBuffer + (node - other.figuresBuffer) : nullptr;
+		};
+		board = other.board;
+		state = other.state;
+		for (byte i = 0; i < 64; i++)
+			figuresBuffer[i] = {other.figuresBuffer[i].pos, rebase(other.figuresBuffer[i].pNext)};
+		whiteList = rebase(other.whiteList);
+		blackList = rebase(other.blackList);
+		network = other.network;
+		accumulators.clear();
+		if (network)
+		{
+			/* Search mustn't allocate, it does at most `max_ply` moves after root move */
+			accumulators.reserve(max_ply + 2);
+			accumulators.push_back(other.accumulators.back());
+		}
+	}
+
+public:
 	/**
 	 * @brief Check if square `pos` can be atacked by side - `!side`.
 	 * This function is mainly used for detecting checks.
@@ -1570,6 +4445,9 @@ private:
 		return false;
 	}
 
+	/**
+	 * @return true if king and rook of `side` didn't move from where short castling starts.
+	 */
 	[[nodiscard]]
 	bool shortCastlingAvailable(Color side) const
 	{
@@ -1589,6 +4467,9 @@ private:
 		return false;
 	}
 
+	/**
+	 * @return true if king and rook of `side` didn't move from where long castling starts.
+	 */
 	[[nodiscard]]
 	bool longCastlingAvailable(Color side) const
 	{
@@ -1608,7 +4489,6 @@ private:
 		return false;
 	}
 
-	
 	/**
 	 * @brief Writes all available captures of current side to `moves`.
 	 * @warning `moves` must be preallocated array with at least 256 elements.
@@ -1983,6 +4863,50 @@ private:
 		std::swap(moves[index], moves[max]);
 	}
 
+	/**
+	 * @brief Check if search must be stopped.
+	 * Called every `poll_interval` nodes.
+	 */
+	void poll() noexcept
+	{
+		const uint64_t nodes = search->nodes += pollChunk;
+		if (search->hasDeadline &&
+			std::chrono::steady_clock::now() >= search->deadline.load())
+			search->stop = true;
+		if (search->nodeLimit && nodes >= search->nodeLimit)
+			search->stop = true;
+		if (search->stop.load(std::memory_order_relaxed))
+			aborted = true;
+		pollChunk = nextPollChunk();
+		nodesUntilPoll = pollChunk;
+		if constexpr (enable_think_info)
+					 publishStats();
+	}
+
+	/**
+	 * @brief Copy this thread's stats to `search` so other threads can read them.
+	 */
+	void publishStats() noexcept
+	{
+		std::lock_guard lock(search->statsMutex);
+		search->threadStats[threadIndex] = state.stats;
+	}
+
+	/**
+	 * @return number of nodes after which search must be polled again.
+	 * It's smaller than `poll_interval` near the node limit so the limit isn't exceeded.
+	 */
+	[[nodiscard]]
+	unsigned nextPollChunk() const noexcept
+	{
+		if (!search->nodeLimit)
+			return poll_interval;
+		const uint64_t nodes = search->nodes;
+		if (nodes >= search->nodeLimit)
+			return poll_interval;
+		return unsigned(std::min<uint64_t>(search->nodeLimit - nodes, poll_interval));
+	}
+
 	/**
 	 * @brief Alpha-beta algorithm. See https://www.chessprogramming.org/Alpha-Beta
 	 */
@@ -1990,17 +4914,75 @@ private:
 	Score alphaBeta(Score alpha, Score beta, int depth, unsigned ply)
 	{
 		if constexpr (enable_think_info)
+					 {
 						 state.positionsTransfered++;
+						 state.stats.selDepth = std::max<uint64_t>(state.stats.selDepth, ply);
+					 }
+		if (--nodesUntilPoll == 0)
+			poll();
+		if (aborted)
+			return ZERO;
+		/* Neither side can win with remaining material */
+		if (evalMaterial().draw)
+			return DRAW;
 		if (depth <= 0 || ply >= max_ply)
 		{
 			if constexpr (enable_think_info)
 							 state.positionsEvaluated++;
-			return evaluate();
+			return evaluate(alpha, beta);
+		}
+
+		using Bound = TranspositionTable::Bound;
+		const Move noMove = makeMove(Square::A1, Square::A1);
+		Move hashMove = noMove;
+		TranspositionTable::Entry entry;
+		if constexpr (enable_think_info)
+						 state.stats.ttProbes++;
+		if ((search->laterLine && search->linesTable->probe(state.hash, entry)) ||
+			tt->probe(state.hash, entry))
+		{
+			if constexpr (enable_think_info)
+							 state.stats.ttHits++;
+			hashMove = entry.move;
+			if (entry.depth >= depth)
+			{
+				const Score score = scoreFromTT(entry.score, ply);
+				if (entry.bound == Bound::EXACT ||
+					(entry.bound == Bound::LOWER && score >= beta) ||
+					(entry.bound == Bound::UPPER && score <= alpha))
+				{
+					if constexpr (enable_think_info)
+									 state.stats.ttCutoffs++;
+					return score;
+				}
+			}
 		}
 
 		const bool wasCheck = state.isCheck = isCheck(state.side);
 		const Color us = state.side;
-		bool moved = false;
+		const Score oldAlpha = alpha;
+		TranspositionTable& stores = search->laterLine ? *search->linesTable : *tt;
+		Move bestMove = noMove;
+		/* Number of legal moves searched */
+		unsigned moved = 0;
+
+		/* Deep in the tree only captures are searched, so side to move
+		 * may refuse to capture and keep static score (stand pat).
+		 * See https://www.chessprogramming.org/Quiescence_Search#Standing_Pat */
+		const bool quiescence = ply >= quiescence_ply && !wasCheck;
+		if (quiescence)
+		{
+			if constexpr (enable_think_info)
+						 {
+							 state.positionsEvaluated++;
+							 state.stats.quiescenceNodes++;
+						 }
+			const Score standPat = evaluate(alpha, beta);
+			if (standPat >= beta)
+				return standPat;
+			if (standPat > alpha)
+				alpha = standPat;
+		}
 
 		if (!wasCheck && depth > 2)
 		{
@@ -2009,15 +4991,26 @@ private:
 			state.side = !state.side; /* Do zero move */
 			auto w = state.enPassantAvailable;
 			state.enPassantAvailable = 8;
+			const auto hash = state.hash;
+			state.hash ^= zobrist.side ^ zobrist.enPassant[w];
+			if constexpr (enable_think_info)
+							 state.stats.nullMoveTries++;
 
 			Score zeroMove = -alphaBeta(-beta, -alpha, depth - 1 - R, ply + 1 + R);
 			// Score zeroMove = -alphaBeta(-beta, -beta +1, depth - 1 - R, ply + 1 + R);
 
 			state.side = !state.side; /* Undo zero move */
 			state.enPassantAvailable = w;
+			state.hash = hash;
 
+			if (aborted)
+				return ZERO;
 			if (zeroMove >= beta)
+			{
+				if constexpr (enable_think_info)
+								 state.stats.nullMoveCutoffs++;
 				return beta;
+			}
 		}
 
 		if (wasCheck && depth <= 2) /* Compute deeper when check */
@@ -2025,8 +5018,12 @@ private:
 		
 		VectorOnStack<MoveEx, max_available_moves> moves;
 		genCaptures(moves);
-		if (ply < 7) /* generate 'quiet' moves only in the beginning of the tree */
+		if (ply < quiescence_ply) /* generate 'quiet' moves only in the beginning of the tree */
 			genMoves(moves);
+		if (hashMove != noMove) /* best move from previous search is tried first */
+			for (auto& moveEx : moves)
+				if (moveEx.move == hashMove)
+					moveEx.score = INT16_MAX;
 		
 		for (unsigned i = 0; i < moves.size(); i++)
 		{
@@ -2035,27 +5032,175 @@ private:
 			const bool check = state.isCheck = isCheck(us);
 			if (!check)
 			{
-				moved = true;
+				moved++;
 				Score score = -alphaBeta(-beta, -alpha, depth - 1, ply + 1);
 				undoMove(undo);
-				if (score > alpha) alpha = score;
+				if (aborted)
+					return ZERO;
+				if (score > alpha)
+				{
+					alpha = score;
+					bestMove = moves[i].move;
+				}
 				if (alpha >= beta)
+				{
+					const bool stored = stores.store(state.hash, bestMove, scoreToTT(alpha, ply), depth, Bound::LOWER);
+					if constexpr (enable_think_info)
+								 {
+									 state.ttWriteConflicts += !stored;
+									 state.stats.cutNodes++;
+									 state.stats.betaCutoffs++;
+									 state.stats.firstMoveCutoffs += moved == 1;
+								 }
 					return alpha;
+				}
 			}
 			else undoMove(undo);
 			state.isCheck = wasCheck;
 		}
 
-		if (!moved)
+		if (!moved)
+		{
+			if (wasCheck) return MATE - ply;
+			else if (quiescence) return alpha;
+			else return DRAW;
+		}
+
+		const bool stored = stores.store(state.hash, bestMove, scoreToTT(alpha, ply), depth,
+										 (alpha > oldAlpha) ? Bound::EXACT : Bound::UPPER);
+		if constexpr (enable_think_info)
+					 {
+						 state.ttWriteConflicts += !stored;
+						 if (alpha > oldAlpha)
+							 state.stats.pvNodes++;
+						 else state.stats.allNodes++;
+					 }
+		return alpha;
+	}
+
+	/**
+	 * @brief Convert mate score so it doesn't depend on `ply`.
+	 */
+	[[nodiscard]]
+	static constexpr Score scoreToTT(Score score, unsigned ply) noexcept
+	{
+		if (score <= MATE) return score + ply;
+		if (score >= -MATE) return score - ply;
+		return score;
+	}
+
+	/**
+	 * @brief Inverse of `scoreToTT()`.
+	 */
+	[[nodiscard]]
+	static constexpr Score scoreFromTT(Score score, unsigned ply) noexcept
+	{
+		if (score <= MATE) return score - ply;
+		if (score >= -MATE) return score + ply;
+		return score;
+	}
+
+public:
+	/**
+	 * @brief Statically evaluates position.
+	 * While engine searches, evaluations are looked up in eval cache first.
+	 */
+	[[nodiscard]]
+	Score evaluate() const
+	{
+		return evaluate(-INF, INF);
+	}
+
+	/**
+	 * @brief Statically evaluates position if it's score is inside (`alpha`, `beta`).
+	 * @return exact score or approximate score that is
+	 * surely less than `alpha` or greater than `beta`.
+	 */
+	[[nodiscard]]
+	Score evaluate(Score alpha, Score beta) const
+	{
+		Score score;
+		bool complete;
+		if (evalCache)
+		{
+			if (evalCache->probe(state.hash, score))
+			{
+				evalStats.hits++;
+				return score;
+			}
+			if (enable_think_info && ++evalStats.misses % eval_time_sample == 0)
+			{
+				const auto start = std::chrono::steady_clock::now();
+				score = computeEvaluation(alpha, beta, complete);
+				evalStats.sampledTime += std::chrono::steady_clock::now() - start;
+				evalStats.samples++;
+			}
+			else score = computeEvaluation(alpha, beta, complete);
+			if (complete)
+				evalCache->store(state.hash, score);
+			return score;
+		}
+		return computeEvaluation(alpha, beta, complete);
+	}
+
+	/**
+	 * @brief Play captures until position is quiet.
+	 * Captures are the line found by quiescence search, so quiescence score
+	 * of position is static evaluation of position after them.
+	 * See https://www.chessprogramming.org/Texel%27s_Tuning_Method
+	 * @return made moves, take them back with `undoMove()` in reverse order.
+	 */
+	VectorOnStack<MoveInfo, max_ply> resolveCaptures()
+	{
+		VectorOnStack<Move, max_ply> line;
+		quiescence(-INF, INF, 0, line);
+		VectorOnStack<MoveInfo, max_ply> moves;
+		for (Move move : line)
+			moves.push_back(doMove(move));
+		return moves;
+	}
+
+private:
+	/**
+	 * @brief Search captures without transposition table, side to move may stand pat.
+	 * @param line gets captures leading to position score is taken from.
+	 */
+	Score quiescence(Score alpha, Score beta, unsigned ply, VectorOnStack<Move, max_ply>& line)
+	{
+		line.clear();
+		const Score standPat = evaluate(alpha, beta);
+		if (standPat >= beta || ply >= max_ply)
+			return standPat;
+		if (standPat > alpha)
+			alpha = standPat;
+
+		const Color us = state.side;
+		VectorOnStack<MoveEx, max_available_moves> moves;
+		VectorOnStack<Move, max_ply> childLine;
+		genCaptures(moves);
+		for (unsigned i = 0; i < moves.size(); i++)
 		{
-			if (wasCheck) return MATE - ply;
-			else return DRAW;
+			pick(moves, i);
+			auto undo = doMove(moves[i].move);
+			if (!isCheck(us))
+			{
+				const Score score = -quiescence(-beta, -alpha, ply + 1, childLine);
+				if (score > alpha)
+				{
+					alpha = score;
+					line.clear();
+					line.push_back(moves[i].move);
+					for (Move move : childLine)
+						line.push_back(move);
+				}
+			}
+			undoMove(undo);
+			if (alpha >= beta)
+				break;
 		}
-		
 		return alpha;
 	}
 
-public:
 	/**
 	 * @brief Statically evaluates position.
 	 * Most things that implemented in this function
@@ -2063,19 +5208,62 @@ public:
 	 * Thank you, Chess Programming Wiki!
 	 */
 	[[nodiscard]]
-	Score evaluate() const
-	{	
-		Score score = ZERO;
+	Score computeEvaluation(Score alpha, Score beta, bool& complete) const
+	{
+		complete = true;
+		if (network)
+			return network->evaluate(accumulators.back(), state.side);
+
+		const MaterialTable::Entry& material = evalMaterial();
+		if (material.endgame)
+		{
+			const bool white = material.strongSide == Color::WHITE;
+			const Score score = material.endgame(board, white ? whiteList : blackList,
+												 white ? blackList : whiteList);
+			return (material.strongSide == state.side) ? score : -score;
+		}
+
+		/* Material and piece-square scores are updated in `doMove()`,
+		 * here they're only interpolated between middlegame and endgame.
+		 * They're checked by `validate()` */
+		const PawnTable::Entry& pawns = evalPawns();
+		/* Bishop pair, pawnless and knight-pawn terms */
+		ScorePair pair = state.material + pawns.score + material.imbalance;
+		/* Penalty if castling is not available */
+		if (!shortCastlingAvailable(Color::WHITE))
+			pair += evalWeights.noShortCastling;
+		if (!longCastlingAvailable(Color::WHITE))
+			pair += evalWeights.noLongCastling;
+		if (!shortCastlingAvailable(Color::BLACK))
+			pair -= evalWeights.noShortCastling;
+		if (!longCastlingAvailable(Color::BLACK))
+			pair -= evalWeights.noLongCastling;
+		const Score phase = std::min(state.phase, MIDDLEGAME_PHASE);
+		Score score = (middlegameScore(pair) * phase +
+					   endgameScore(pair) * (MIDDLEGAME_PHASE - phase)) / MIDDLEGAME_PHASE;
+
+		/* Terms below are expensive but can't change score much */
+		{
+			Score estimate = score * material.scale[score > 0 ? 0 : 1] / MaterialTable::normal_scale;
+			if (state.side == Color::BLACK) estimate = -estimate;
+			if (estimate + lazy_margin <= alpha || estimate - lazy_margin >= beta)
+			{
+				complete = false;
+				return estimate;
+			}
+		}
 
-		byte whiteCount[toByte(Code::KING) + 1] = {0};
-		byte blackCount[toByte(Code::KING) + 1] = {0};
 		const bool whiteCheck = isCheck(Color::WHITE);
 		const bool blackCheck = isCheck(Color::BLACK);
+		const BoardMasks masks = boardMasks(board);
+		score += kernels.sliderMobility(masks, Color::WHITE) - kernels.sliderMobility(masks, Color::BLACK);
 
 		for (auto node = whiteList; node; node = node->pNext)
 		{
-			auto code = get<Code>(board[node->pos]);
-			whiteCount[toByte(code)]++;
+			const auto code = get<Code>(board[node->pos]);
+			/* Bonus for pawns attacking pieces */
+			if (pawns.attacks[1] & toBitboard(node->pos))
+				score -= toByte(code) + 2;
 			switch(code)
 			{
 				case Code::PAWN:
@@ -2085,13 +5273,9 @@ public:
 					score += evalKnight(node->pos);
 					break;
 				case Code::BISHOP:
-					score += evalBishop(node->pos);
-					break;
 				case Code::ROOK:
-					score += evalRook(node->pos);
-					break;
 				case Code::QUEEN:
-					score += evalQueen(node->pos);
+					/* Evaluated by `sliderMobility()` */
 					break;
 				case Code::KING:
 					score += evalKing(node->pos);
@@ -2100,8 +5284,9 @@ public:
 		}
 		for (auto node = blackList; node; node = node->pNext)
 		{
-			auto code = get<Code>(board[node->pos]);
-			blackCount[toByte(code)]++;
+			const auto code = get<Code>(board[node->pos]);
+			if (pawns.attacks[0] & toBitboard(node->pos))
+				score += toByte(code) + 2;
 			switch(code)
 			{
 				case Code::PAWN:
@@ -2111,13 +5296,9 @@ public:
 					score -= evalKnight(node->pos);
 					break;
 				case Code::BISHOP:
-					score -= evalBishop(node->pos);
-					break;
 				case Code::ROOK:
-					score -= evalRook(node->pos);
-					break;
 				case Code::QUEEN:
-					score -= evalQueen(node->pos);
+					/* Evaluated by `sliderMobility()` */
 					break;
 				case Code::KING:
 					score -= evalKing(node->pos);
@@ -2125,114 +5306,62 @@ public:
 			}
 		}
 
-		/* Bonus for the bishop pair */
-		if (whiteCount[toByte(Code::BISHOP)] > 1)
-			score += 18;
-		if (blackCount[toByte(Code::BISHOP)] > 1)
-			score -= 18;
-
-		/* Penalty for having no pawns, as it makes it more difficult to win the endgame */
-		if (whiteCount[toByte(Code::PAWN)] == 0)
-			score -= 50;
-		if (blackCount[toByte(Code::PAWN)] == 0)
-			score += 50;
-
-		/* Penalty if castling is not available */
-		if (!shortCastlingAvailable(Color::WHITE))
-			score -= 25;
-		if (!longCastlingAvailable(Color::WHITE))
-			score -= 23;
-		if (!shortCastlingAvailable(Color::BLACK))
-			score += 25;
-		if (!longCastlingAvailable(Color::BLACK))
-			score += 23;
-		
-		/* Knights lose value as pawns disappear. */
-		score += (whiteCount[toByte(Code::KNIGHT)] * whiteCount[toByte(Code::PAWN)]) << 1;
-		score -= (blackCount[toByte(Code::KNIGHT)] * blackCount[toByte(Code::PAWN)]) << 1;
-
 		if (whiteCheck)
 			score -= 12;
 		if (blackCheck)
 			score += 12;
 
+		/* Winning is harder with some material, e.g. without pawns */
+		score = score * material.scale[score > 0 ? 0 : 1] / MaterialTable::normal_scale;
+
 		if (state.side == Color::BLACK) score = -score;
 		return score;
 	}
 
 private:
+	/**
+	 * @brief Evaluate material or take it from material table.
+	 */
+	const MaterialTable::Entry& evalMaterial() const noexcept
+	{
+		if (auto entry = materialTable.probe(state.materialKey))
+			return *entry;
+		return materialTable.store(state.materialKey, state.pieceCount);
+	}
+
+	/**
+	 * @brief Evaluate pawn structure or take it from pawn table.
+	 */
+	const PawnTable::Entry& evalPawns() const noexcept
+	{
+		if (auto entry = pawnTable.probe(state.pawnHash))
+			return *entry;
+		const BoardMasks masks = boardMasks(board);
+		return pawnTable.store(state.pawnHash, masks.pieces(Color::WHITE, Code::PAWN),
+							   masks.pieces(Color::BLACK, Code::PAWN));
+	}
+
 	/**
 	 * Evaluates pawn.
+	 * Pawn structure is evaluated in `evalPawns()`, here only terms that
+	 * depend on other pieces are computed.
 	 */
 	[[nodiscard]]
 	Score evalPawn(Square square) const
 	{
 		const byte x = getX(square);
 		const byte y = getY(square);
-		Score score = PAWN_SCORE;
-		if (get<Color>(board[square]) == Color::WHITE)
-		{
-			constexpr sbyte evalTable[64] = {
-				0,   0,  0,  0,  0,  0,  0,  0,
-				0,   4,  4,  0,  0,  4,  4,  0,
-				2,   8,  2, 10, 10,  2,  8,  2,
-				4,   8, 12, 18, 18, 12,  8,  4,
-				6,  12, 16, 24, 24, 16, 12,  6,
-				8,  16, 24, 32, 32, 24, 16,  8,
-				20, 36, 36, 36, 36, 36, 36, 20,
-				0,   0,  0,  0,  0,  0,  0,  0,
-			};
-			if (isWhitePawn(board[makeSquare(x, y - 1)]))
-				score -= 5;
-			if (board[makeSquare(x, y + 1)] != Piece::EMPTY)
-				score -= 4;
-			if (x != 0 && isBlack(board[makeSquare(x - 1, y + 1)]))
-				score += toByte(get<Code>(board[makeSquare(x - 1, y + 1)])) + 2;
-			if (x < 7 && isBlack(board[makeSquare(x + 1, y + 1)]))
-				score += toByte(get<Code>(board[makeSquare(x - 1, y + 1)])) + 2;
-			score += evalTable[toByte(square)];
-		}
-		else
-		{
-			constexpr sbyte evalTable[64] = {
-				0,  0,  0,  0,  0,  0,  0,  0,
-				20, 36, 36, 36, 36, 36, 36, 20,
-				8, 16, 24, 32, 32, 24, 16,  8,
-				6, 12, 16, 24, 24, 16, 12,  6,
-				4,  8, 12, 18, 18, 12,  8,  4,
-				2,  8,  2, 10, 10,  2,  8,  2,
-				0,  4,  4,  0,  0,  4,  4,  0,
-				0,  0,  0,  0,  0,  0,  0,  0,
-			};
-			if (isBlackPawn(board[makeSquare(x, y + 1)]))
-				score -= 5;
-			if (board[makeSquare(x, y - 1)] != Piece::EMPTY)
-				score -= 4;
-			if (x != 0 && isWhite(board[makeSquare(x - 1, y + 1)]))
-				score += toByte(get<Code>(board[makeSquare(x - 1, y + 1)])) + 2;
-			if (x < 7 && isWhite(board[makeSquare(x + 1, y + 1)]))
-				score += toByte(get<Code>(board[makeSquare(x - 1, y + 1)])) + 2;
-			score += evalTable[toByte(square)];
-		}
-		
-		return score;
+		const byte frontY = (get<Color>(board[square]) == Color::WHITE) ? y + 1 : y - 1;
+		/* Penalty for a blocked pawn */
+		if (frontY < 8 && board[makeSquare(x, frontY)] != Piece::EMPTY)
+			return -4;
+		return ZERO;
 	}
 
 	[[nodiscard]]
 	Score evalKnight(Square square) const
 	{
-		constexpr sbyte evalTable[64] = {
-			0,  4,  8, 10, 10,  8,  4,  0,
-			4,  8, 20, 20, 20, 20,  8,  4,
-			8, 16, 24, 28, 28, 24, 16,  8,
-			10, 20, 28, 32, 32, 28, 20, 10,
-			10, 20, 28, 32, 32, 28, 20, 10,
-			8, 16, 24, 28, 28, 24, 16,  8,
-			4,  8, 20, 20, 20, 20,  8,  4,
-			0,  4,  8, 10, 10,  8,  4,  0,
-		};
-		Score score = KNIGHT_SCORE;
-		score += evalTable[toByte(square)];
+		Score score = ZERO;
 		const auto x = getX(square);
 		const auto y = getY(square);
 		/* Marginal bonus for a knight defended by a pawn */
@@ -2260,324 +5389,788 @@ private:
 	}
 
 	[[nodiscard]]
-	Score evalBishop(Square square) const
+	Score evalKing(Square square) const
 	{
-		constexpr sbyte evalTable[64] = {
-			2, 0,  0,  0,  0,  0, 0, 2,
-			0, 8,  4,  4,  4,  4, 8, 0,
-			0, 4, 10, 10, 10, 10, 4, 0,
-			0, 4, 10, 10, 10, 10, 4, 0,
-			0, 4, 10, 10, 10, 10, 4, 0,
-			0, 4, 10, 10, 10, 10, 4, 0,
-			0, 8,  4,  4,  4,  4, 8, 0,
-			2, 0,  0,  0,  0,  0, 0, 2,
-		};
-		Score score = BISHOP_SCORE;
-		score += evalTable[toByte(square)];
-		const byte x = getX(square), y = getY(square);
-		for (auto delta : bishopMoves)
+		Score score = ZERO;
+		const auto x = getX(square);
+		const auto y = getY(square);
+		if (get<Color>(board[square]) == Color::WHITE)
 		{
-			byte newX = x, newY = y;
-			for (byte i = 1; i < 8; i++)
+			constexpr SquareEx shieldOffset[3] = {
+				{ byte(1), byte(1) },
+				{ byte(0), byte(1) },
+				{ byte(-1), byte(1) },
+			};
+			for (auto delta : shieldOffset)
 			{
-				newX += delta.x;
-				newY += delta.y;
+				const auto newX = x + delta.x;
+				const auto newY = y + delta.y;
 				if (newX < 8 &&
 					newY < 8)
 				{
-					auto piece = board[makeSquare(newX, newY)];
-					if (piece != Piece::EMPTY)
-					{
-						if (get<Color>(piece) != get<Color>(board[square]))
-							score += 2;
-						break;
-					}
-					score += 1;
+					if (get<Color>(board[makeSquare(newX, newY)]) == Color::WHITE)
+						score += 8;
+				}
+			}
+		}
+		else
+		{
+			constexpr SquareEx shieldOffset[3] = {
+				{ byte(1), byte(-1) },
+				{ byte(0), byte(-1) },
+				{ byte(-1), byte(-1) },
+			};
+			for (auto delta : shieldOffset)
+			{
+				const auto newX = x + delta.x;
+				const auto newY = y + delta.y;
+				if (newX < 8 &&
+					newY < 8)
+				{
+					if (get<Color>(board[makeSquare(newX, newY)]) == Color::WHITE)
+						score -= 8;
 				}
-				else break;
 			}
 		}
 		return score;
 	}
 
+public:
+	class NoMovesAvailable : public std::logic_error
+	{
+		NoMovesAvailable(GameState state)
+			: std::logic_error("Engine::think: there're no moves available"),
+			  state(state) { }
+	public:
+		GameState state;
+
+		friend class Engine;
+	};	
+
+	/**
+	 * @brief Find best move for current side.
+	 * Blocks until search is finished.
+	 */
+	[[nodiscard]]
+	Move think(int preferedDepth = 7)
+	{
+		Limits limits;
+		limits.depth = preferedDepth;
+		return startThink(limits).get();
+	}
+
+	/**
+	 * @brief Start searching best move for current side in background.
+	 * @detail Search is done on copies of the position so board and state
+	 * can be read while engine is thinking, but they must not be changed
+	 * until search is finished.
+	 * If there're no moves available returned future throws `NoMovesAvailable`.
+	 * @return future that will hold the best move.
+	 */
+	std::shared_future<Move> startThink(Limits limits)
+	{
+		stop();
+		wait();
+
+		if (limits.deterministic)
+		{
+			limits.threads = 1;
+			limits.time = limits.increment = limits.moveTime = std::chrono::milliseconds(0);
+			limits.ponder = false;
+		}
+
+		if (!pool)
+		{
+			pool = std::make_unique<ThreadPool>();
+			control = std::make_unique<SearchControl>();
+		}
+		if (!table)
+			table = std::make_unique<TranspositionTable>(hashSize);
+		if (!cache)
+			cache = std::make_unique<EvalCache>(evalCacheSize);
+		if (!linesTable && limits.multiPV > 1)
+			linesTable = std::make_unique<TranspositionTable>(hashSize);
+		if (limits.deterministic)
+		{
+			table->clear();
+			cache->clear();
+			if (linesTable)
+				linesTable->clear();
+		}
+		table->newSearch();
+		if (linesTable)
+			linesTable->newSearch();
+#ifdef KAREN_ENABLE_PARALLEL
+		const unsigned threads = std::max(limits.threads, 1u);
+#else
+		const unsigned threads = 1;
+#endif
+		pool->reserve(threads);
+		control->nodes = 0;
+		control->nodeLimit = limits.nodes;
+		while (workers.size() < threads)
+			workers.emplace_back(new Engine());
+		for (unsigned i = 0; i < threads; i++)
+		{
+			workers[i]->copyPosition(*this);
+			workers[i]->search = control.get();
+			workers[i]->tt = table.get();
+			workers[i]->evalCache = cache.get();
+			workers[i]->evalStats = {};
+			workers[i]->aborted = false;
+			workers[i]->pollChunk = workers[i]->nextPollChunk();
+			workers[i]->nodesUntilPoll = workers[i]->pollChunk;
+			workers[i]->threadIndex = i;
+			if constexpr (enable_tracing)
+						 if (!workers[i]->traceBuffer)
+							 workers[i]->traceBuffer = std::make_unique<TraceBuffer>();
+			if constexpr (enable_think_info)
+						 {
+							 workers[i]->state.positionsTransfered = 0;
+							 workers[i]->state.positionsEvaluated = 0;
+							 workers[i]->state.ttWriteConflicts = 0;
+							 workers[i]->state.lockWaits = 0;
+							 workers[i]->state.stats = {};
+						 }
+		}
+		{
+			std::lock_guard lock(control->statsMutex);
+			control->threadStats.assign(threads, {});
+			control->iterations.clear();
+			/* Search mustn't allocate */
+			if constexpr (instrumentation >= Instrumentation::TRACING)
+							 control->iterations.reserve(std::max(limits.depth, 1));
+		}
+		control->stop = false;
+		control->pondering = limits.ponder;
+		control->laterLine = false;
+		control->linesTable = linesTable.get();
+		control->depth = 0;
+		control->bestMove = makeMove(Square::A1, Square::A1);
+		timeManager.start(limits);
+		control->hasDeadline = timeManager.isEnabled() && !limits.ponder;
+		control->deadline = timeManager.deadline();
+
+#ifdef KAREN_ENABLE_PARALLEL
+		/* Helpers are started once per search so search threads don't allocate,
+		 * they're submitted first as main thread reads `helperTasks` */
+		control->helperJob = 0;
+		control->helpersRunning = threads - 1;
+		control->helpersBusy = 0;
+		control->helpersQuit = false;
+		helperTasks.clear();
+		for (unsigned i = 1; i < threads; i++)
+			helperTasks.push_back(pool->submit([this, i] { helpRoot(i); }));
+#endif
+		thinking = pool->submit([this, limits, threads] { return searchRoot(limits, threads); }).share();
+		return thinking;
+	}
+
+	/**
+	 * @brief Find `limits.multiPV` best moves for current side.
+	 * Blocks until search is finished.
+	 * @return lines ranked from the best to the worst.
+	 */
+	[[nodiscard]]
+	std::vector<Line> analyze(const Limits& limits)
+	{
+		startThink(limits).get();
+		std::vector<Line> result;
+		for (auto [move, score] : control->lines)
+			result.push_back({move, score, principalVariation(move, !result.empty())});
+		return result;
+	}
+
+	/**
+	 * @brief Ask current search to finish as soon as possible.
+	 * Search will return the best move it found so far.
+	 */
+	void stop() noexcept
+	{
+		if (control)
+			control->stop = true;
+	}
+
+	/**
+	 * @brief Tell pondering search that opponent played the expected move.
+	 * @detail Search continues and from now on it obeys time limits
+	 * that were passed to `startThink()`; time is counted from this call.
+	 */
+	void ponderhit() noexcept
+	{
+		if (!control || !control->pondering)
+			return;
+		timeManager.restart();
+		control->deadline = timeManager.deadline();
+		control->hasDeadline = timeManager.isEnabled();
+		control->pondering = false;
+	}
+
+	/**
+	 * @return best move found so far by current or last search.
+	 * Can be called while engine is thinking.
+	 */
+	[[nodiscard]]
+	Move bestMove() const noexcept
+	{
+		return control ? control->bestMove.load() : makeMove(Square::A1, Square::A1);
+	}
+
+	/**
+	 * @return depth of the last iteration completed by current or last search.
+	 * Can be called while engine is thinking.
+	 */
+	[[nodiscard]]
+	int completedDepth() const noexcept
+	{
+		return control ? control->depth.load() : 0;
+	}
+
+	/**
+	 * @return number of nodes searched by the last search.
+	 * While search is running the value is updated every few thousands nodes.
+	 */
+	[[nodiscard]]
+	uint64_t nodesSearched() const noexcept
+	{
+		return control ? control->nodes.load() : 0;
+	}
+
+	/**
+	 * @return completed iterations of current or last search, empty unless
+	 * instrumentation is `Instrumentation::TRACING`.
+	 */
+	[[nodiscard]]
+	std::vector<Iteration> iterations() const
+	{
+		if (!control)
+			return {};
+		std::lock_guard lock(control->statsMutex);
+		return control->iterations;
+	}
+
+	/**
+	 * @brief Record event in trace of this engine when instrumentation is
+	 * `Instrumentation::TRACING`, otherwise do nothing.
+	 * @detail Must be called by one thread at a time, one that owns engine.
+	 * Search threads record their events themselves.
+	 */
+	void trace(TraceEvent event, unsigned value = 0, Move move = makeMove(Square::A1, Square::A1),
+			   Score score = ZERO) noexcept
+	{
+		if constexpr (enable_tracing)
+					 if (traceBuffer)
+						 traceBuffer->record(event, value, move, score);
+	}
+
+	/**
+	 * @brief Write events recorded by this engine and its search threads
+	 * as Chrome trace event JSON, it can be opened in Perfetto or chrome://tracing.
+	 * See https://docs.google.com/document/d/1CvAClvFfyA5R-PhYUmn5OOQtYMH4h6I0nSsKchNAySU
+	 * @detail Thread 0 is the thread which owns engine, others are search threads.
+	 */
+	void writeTrace(std::ostream& stream) const
+	{
+		std::vector<std::vector<TraceBuffer::Event>> threads;
+		threads.push_back(traceBuffer ? traceBuffer->read() : std::vector<TraceBuffer::Event>{});
+		for (const auto& worker : workers)
+			threads.push_back(worker->traceBuffer ? worker->traceBuffer->read() : std::vector<TraceBuffer::Event>{});
+		uint64_t start = UINT64_MAX;
+		for (const auto& events : threads)
+			if (!events.empty())
+				start = std::min(start, events.front().time);
+
+		stream << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+		bool first = true;
+		const auto begin = [&](const char* phase, size_t tid, uint64_t time) -> std::ostream& {
+			char ts[32];
+			std::snprintf(ts, sizeof(ts), "%.3f", double(time - start) / 1000);
+			stream << (first ? "\n" : ",\n") << "{\"ph\":\"" << phase << "\",\"pid\":1,\"tid\":" << tid
+				   << ",\"ts\":" << ts;
+			first = false;
+			return stream;
+		};
+		for (size_t tid = 0; tid < threads.size(); tid++)
+		{
+			stream << (first ? "\n" : ",\n") << "{\"ph\":\"M\",\"pid\":1,\"tid\":" << tid
+				   << ",\"name\":\"thread_name\",\"args\":{\"name\":\""
+				   << (tid ? "search thread " + std::to_string(tid - 1) : std::string("game")) << "\"}}";
+			first = false;
+			/* Ends of events which beginnings were overwritten are skipped */
+			unsigned open = 0;
+			for (const auto& event : threads[tid])
+			{
+				const std::string move = to_string(event.move);
+				switch (event.type)
+				{
+					case TraceEvent::THINK_BEGIN:
+						begin("B", tid, event.time) << ",\"name\":\"think\",\"args\":{\"half_move\":"
+													<< event.value << "}}";
+						open++;
+						break;
+					case TraceEvent::ITERATION_BEGIN:
+						begin("B", tid, event.time) << ",\"name\":\"depth " << event.value << "\"}";
+						open++;
+						break;
+					case TraceEvent::ROOT_MOVE_BEGIN:
+						begin("B", tid, event.time) << ",\"name\":\"" << move << "\",\"args\":{\"depth\":"
+													<< event.value << "}}";
+						open++;
+						break;
+					case TraceEvent::THINK_END:
+					case TraceEvent::ITERATION_END:
+					case TraceEvent::ROOT_MOVE_FAIL_LOW:
+					case TraceEvent::ROOT_MOVE_FAIL_HIGH:
+						if (open == 0)
+							break;
+						open--;
+						begin("E", tid, event.time) << ",\"args\":{\"move\":\"" << move << "\"";
+						if (event.type == TraceEvent::ROOT_MOVE_FAIL_LOW)
+							stream << ",\"result\":\"fail low\"";
+						if (event.type == TraceEvent::ROOT_MOVE_FAIL_HIGH)
+							stream << ",\"result\":\"fail high\"";
+						if (event.type != TraceEvent::THINK_END)
+							stream << ",\"score\":" << event.score;
+						stream << "}}";
+						break;
+					case TraceEvent::BEST_MOVE_CHANGE:
+						begin("i", tid, event.time) << ",\"s\":\"t\",\"name\":\"best move change\",\"args\":{\"move\":\""
+													<< move << "\",\"score\":" << event.score << ",\"depth\":"
+													<< event.value << "}}";
+						break;
+				}
+			}
+		}
+		stream << "\n]}\n";
+	}
+
+	/**
+	 * @return stats of current or last search summed over its threads.
+	 * While search is running they're updated every few thousands nodes.
+	 */
+	[[nodiscard]]
+	SearchStats searchStats() const
+	{
+		SearchStats sum;
+		if (!control)
+			return sum;
+		std::lock_guard lock(control->statsMutex);
+		for (const auto& stats : control->threadStats)
+			sum += stats;
+		return sum;
+	}
+
+	/**
+	 * @param laterLine probe table of multi-PV lines after the first one before the main table.
+	 * @return best move for current position stored in transposition table
+	 * or A1A1 if there's no such move.
+	 */
+	[[nodiscard]]
+	Move hashMove(bool laterLine = false) const
+	{
+		const Move noMove = makeMove(Square::A1, Square::A1);
+		TranspositionTable::Entry entry;
+		const bool found = (laterLine && linesTable && linesTable->probe(state.hash, entry)) ||
+			(table && table->probe(state.hash, entry));
+		if (!found || entry.move == noMove)
+			return noMove;
+		for (auto move : availableMoves(true))
+			if (move == entry.move)
+				return move;
+		return noMove;
+	}
+
+	/**
+	 * @brief Collect line that starts with `move` from transposition table.
+	 * @param laterLine `move` is of multi-PV line after the first one.
+	 */
+	[[nodiscard]]
+	std::vector<Move> principalVariation(Move move, bool laterLine = false) const
+	{
+		const Move noMove = makeMove(Square::A1, Square::A1);
+		/* Need const_cast to do moves but nothing changes because we undo them. */
+		auto mutThis = const_cast<Engine*>(this);
+		std::vector<Move> pv;
+		VectorOnStack<MoveInfo, max_ply> undo;
+		while (move != noMove && pv.size() < max_ply)
+		{
+			pv.push_back(move);
+			undo.push_back(mutThis->doMove(move));
+			move = hashMove(laterLine);
+		}
+		while (undo.size() > 0)
+		{
+			mutThis->undoMove(undo[undo.size() - 1]);
+			undo.pop_back();
+		}
+		return pv;
+	}
+
+	/**
+	 * @brief Set size of transposition table in megabytes.
+	 * Table is cleared.
+	 */
+	void setHashSize(unsigned megabytes)
+	{
+		stop();
+		wait();
+		hashSize = megabytes;
+		if (table)
+			table->resize(megabytes);
+		if (linesTable)
+			linesTable->resize(megabytes);
+	}
+
+	/**
+	 * @brief Evaluate positions with `network` or with hand-written
+	 * evaluation if it's nullptr.
+	 */
+	void setNetwork(std::shared_ptr<const Network> network)
+	{
+		stop();
+		wait();
+		this->network = std::move(network);
+		if (cache)
+			cache->clear();
+		computeIncremental();
+	}
+
+	/**
+	 * @brief Set size of eval cache.
+	 * It's better to keep it small enough to fit in L2 cache.
+	 */
+	void setEvalCacheSize(unsigned kilobytes)
+	{
+		stop();
+		wait();
+		evalCacheSize = kilobytes;
+		if (cache)
+			cache->resize(kilobytes);
+	}
+
+	/**
+	 * @brief Block until current search is finished.
+	 */
+	void wait() const
+	{
+		if (thinking.valid())
+			thinking.wait();
+	}
+
+	/**
+	 * @return true if search is running.
+	 */
 	[[nodiscard]]
-	Score evalRook(Square square) const
+	bool isThinking() const
 	{
-		Score score = ROOK_SCORE;
-		const auto x = getX(square);
-		const auto y = getY(square);
-		constexpr SquareEx offsets[4] = {
-			{byte(1), byte(0)},
-			{byte(-1), byte(0)},
-			{byte(0), byte(1)},
-			{byte(0), byte(-1)},
-		};
-		if (get<Color>(board[square]) == Color::WHITE)
+		using namespace std::chrono_literals;
+		return thinking.valid() &&
+			thinking.wait_for(0s) != std::future_status::ready;
+	}
+
+private:
+	/**
+	 * @brief Search root moves with first `threads` workers.
+	 * Runs on one of pool's threads.
+	 * @detail Iterative deepening is used: position is searched to
+	 * depth 1, 2, ... until `limits.depth` is reached or time is over.
+	 * Best move of every iteration is searched first in the next one.
+	 */
+	Move searchRoot(const Limits& limits, unsigned threads)
+	{
+#ifdef KAREN_ENABLE_PARALLEL
+		/* Helpers must leave `helpRoot()` before search finishes, even if it throws */
+		struct HelpersGuard
 		{
-			for (auto delta : offsets)
+			Engine& engine;
+			bool active = true;
+			~HelpersGuard()
 			{
-				byte newX = x + delta.x;
-				byte newY = y + delta.y;
-				if (newX < 8 &&
-					newY < 8)
-				{
-					if (isWhiteRook(board[makeSquare(newX, newY)]) ||
-						isWhiteQueen(board[makeSquare(newX, newY)]))
-						score += 5;
-				}
+				if (!active)
+					return;
+				engine.control->stop = true;
+				engine.stopHelpers();
 			}
-			constexpr sbyte evalTable[64] = {
-				0,  0, 0, 5, 5, 0, 0,  0,
-				-5, 0, 0, 0, 0, 0, 0, -5,
-				-5, 0, 0, 0, 0, 0, 0, -5,
-				-5, 0, 0, 0, 0, 0, 0, -5,
-				-5, 0, 0, 0, 0, 0, 0, -5,
-				-5, 0, 0, 0, 0, 0, 0, -5,
-				5,  7, 7, 7, 7, 7, 7,  5,
-				0,  0, 0, 0, 0, 0, 0,  0,
-			};
-			score += evalTable[toByte(square)];
-		}
-		else
+		} helpersGuard{*this};
+#endif
+		Engine& main = *workers[0];
+		main.state.isCheck = main.isCheck(main.state.side);
+
+		auto& moves = control->rootMoves;
+		moves.clear();
 		{
-			for (auto delta : offsets)
+			VectorOnStack<MoveEx, max_available_moves> pseudoLegal;
+			main.genCaptures(pseudoLegal);
+			main.genMoves(pseudoLegal);
+			std::sort(pseudoLegal.begin(), pseudoLegal.end(), std::greater{});
+			const Color us = main.state.side;
+			for (auto moveEx : pseudoLegal)
 			{
-				byte newX = x + delta.x;
-				byte newY = y + delta.y;
-				if (newX < 8 &&
-					newY < 8)
-				{
-					if (isBlackRook(board[makeSquare(newX, newY)]) ||
-						isBlackQueen(board[makeSquare(newX, newY)]))
-						score += 5;
-				}
+				auto st = main.doMove(moveEx.move);
+				if (!main.isCheck(us))
+					moves.push_back(moveEx);
+				main.undoMove(st);
 			}
-			constexpr sbyte evalTable[64] = {
-				0,  0, 0, 0, 0, 0, 0,  0,
-				5,  7, 7, 7, 7, 7, 7,  5,
-				-5, 0, 0, 0, 0, 0, 0, -5,
-				-5, 0, 0, 0, 0, 0, 0, -5,
-				-5, 0, 0, 0, 0, 0, 0, -5,
-				-5, 0, 0, 0, 0, 0, 0, -5,
-				-5, 0, 0, 0, 0, 0, 0, -5,
-				0,  0, 0, 5, 5, 0, 0,  0
-			};
-			score += evalTable[toByte(square)];
 		}
-		for (auto delta : rookMoves)
+		if (moves.size() == 0)
 		{
-			byte newX = x, newY = y;
-			for (byte i = 1; i < 8; i++)
-			{
-				newX += delta.x;
-				newY += delta.y;
-				if (newX < 8 &&
-					newY < 8)
-				{
-					auto piece = board[makeSquare(newX, newY)];
-					if (piece != Piece::EMPTY)
-					{
-						if (get<Color>(piece) != get<Color>(board[square]))
-							score += 2;
-						/* Rooks defending each other */
-						else if (isRook(piece) || isQueen(piece))
-							score += 4;
-						break;
-					}
-					score += 1;
-				}
-				else break;
-			}
+			if (main.state.isCheck) throw NoMovesAvailable(GameState::MATE);
+			else throw NoMovesAvailable(GameState::DRAW);
 		}
-		return score;
-	}
 
-	[[nodiscard]]
-	Score evalQueen(Square square) const
-	{
-		Score score = QUEEN_SCORE;
-		const auto x = getX(square);
-		const auto y = getY(square);
-		if (get<Color>(board[square]) == Color::WHITE)
-		{
-			constexpr sbyte evalTable[64] = {
-				-20,-10,-10, -5, -5,-10,-10,-20,
-				-10,  0,  0,  0,  0,  0,  0,-10,
-				-10,  0,  5,  5,  5,  5,  0,-10,
-				-5,  0,  5,  5,  5,  5,  0,  0,
-				-5,  0,  5,  5,  5,  5,  0, -5,
-				-10,  5,  5,  5,  5,  5,  0,-10,
-				-10,  0,  5,  0,  0,  0,  0,-10,
-				-20,-10,-10, -5, -5,-10,-10,-20
-			};
-			score += evalTable[toByte(square)];
-		}
-		else
-		{
-			constexpr sbyte evalTable[64] = {
-				-20,-10,-10, -5, -5,-10,-10,-20,
-				-10,  0,  0,  0,  0,  0,  0,-10,
-				-10,  0,  5,  5,  5,  5,  0,-10,
-				-5,  0,  5,  5,  5,  5,  0, -5,
-				0,  0,  5,  5,  5,  5,  0, -5,
-				-10,  5,  5,  5,  5,  5,  0,-10,
-				-10,  0,  5,  0,  0,  0,  0,-10,
-				-20,-10,-10, -5, -5,-10,-10,-20
-			};
-			score += evalTable[toByte(square)];
-		}
-		for (auto delta : queenNKingMoves)
+		int completedDepth = 0;
+		/* There's nothing to think about when only one move is available */
+		const int maxDepth = (timeManager.isEnabled() && moves.size() == 1) ? 1 : limits.depth;
+		const unsigned multiPV = std::clamp(limits.multiPV, 1u, moves.size());
+		VectorOnStack<RootLine, max_available_moves> lines;
+		/* Order of root moves after the first line, next iteration starts with it */
+		VectorOnStack<MoveEx, max_available_moves> firstLineOrder;
+		control->lines.clear();
+
+		Move previousBest = makeMove(Square::A1, Square::A1);
+		for (int depth = 1; depth <= maxDepth; depth++)
 		{
-			byte newX = x, newY = y;
-			for (byte i = 1; i < 8; i++)
+			main.trace(TraceEvent::ITERATION_BEGIN, depth);
+			/* Every line is searched without moves of lines found before it.
+			 * The first line searches all moves like single line search does
+			 * and only it writes the main table, so it finds the same move */
+			lines.clear();
+			for (unsigned pvIndex = 0; pvIndex < multiPV; pvIndex++)
 			{
-				newX += delta.x;
-				newY += delta.y;
-				if (newX < 8 &&
-					newY < 8)
-				{
-					auto piece = board[makeSquare(newX, newY)];
-					if (piece != Piece::EMPTY)
-					{
-						if (get<Color>(piece) != get<Color>(board[square]))
-							score += 2;
-						break;
-					}
-					score += 1;
-				}
-				else break;
+				control->laterLine = pvIndex > 0;
+				control->nextRootMove = pvIndex;
+				control->alpha = -INF * 2;
+				control->lineMove = makeMove(Square::A1, Square::A1);
+				control->lineComplete = false;
+
+				/* First move is searched alone to get good alpha for the rest */
+				main.searchRootMoves(depth, true);
+
+#ifdef KAREN_ENABLE_PARALLEL
+				startHelpers(depth);
+				main.searchRootMoves(depth, false);
+				joinHelpers();
+#else
+				main.searchRootMoves(depth, false);
+#endif
+
+				/* Best move of interrupted iteration is still better than moves searched before it */
+				if (pvIndex == 0 && (control->lineComplete ||
+									 control->bestMove == makeMove(Square::A1, Square::A1)))
+					control->bestMove = control->lineMove.load();
+				if (control->stop)
+					break;
+
+				/* Move the best move right after moves of previous lines, others keep their order */
+				auto best = std::find_if(moves.begin() + pvIndex, moves.end(), [this](MoveEx moveEx) {
+					return moveEx.move == control->lineMove;
+				});
+				std::rotate(moves.begin() + pvIndex, best, best + 1);
+				lines.push_back({control->lineMove, control->alpha});
+				if (pvIndex == 0 && multiPV > 1)
+					firstLineOrder = moves;
 			}
+			control->laterLine = false;
+			if (control->stop)
+			{
+				main.trace(TraceEvent::ITERATION_END, depth, control->bestMove, control->alpha);
+				break;
+			}
+			/* Later lines are searched with different windows so they can get better score,
+			 * but the first line found every other move to be no better than its one.
+			 * Insertion sort is stable and unlike std::stable_sort doesn't allocate */
+			for (unsigned i = 1; i < lines.size(); i++)
+				lines[i].score = std::min(lines[i].score, lines[0].score);
+			for (unsigned i = 2; i < lines.size(); i++)
+				for (unsigned j = i; j > 1 && lines[j - 1].score < lines[j].score; j--)
+					std::swap(lines[j - 1], lines[j]);
+			if (multiPV > 1)
+				moves = firstLineOrder;
+			control->bestMove = lines[0].move;
+			main.trace(TraceEvent::ITERATION_END, depth, lines[0].move, lines[0].score);
+			if (depth > 1 && lines[0].move != previousBest)
+				main.trace(TraceEvent::BEST_MOVE_CHANGE, depth, lines[0].move, lines[0].score);
+			previousBest = lines[0].move;
+			completedDepth = depth;
+			control->depth = depth;
+			control->lines = lines;
+			table->store(main.state.hash, lines[0].move, scoreToTT(lines[0].score, 0),
+						 depth + 1, TranspositionTable::Bound::EXACT);
+			if constexpr (instrumentation >= Instrumentation::TRACING)
+						 {
+							 std::lock_guard lock(control->statsMutex);
+							 control->iterations.push_back({
+									 depth, timeManager.elapsed(), control->nodes.load(), lines[0].move, lines[0].score });
+						 }
+
+			if (timeManager.iterationDone(lines[0].move, lines[0].score) &&
+				!control->pondering)
+				break;
 		}
-		return score;
-	};
+#ifdef KAREN_ENABLE_PARALLEL
+		helpersGuard.active = false;
+		stopHelpers();
+		/* Errors of helpers are errors of search */
+		for (auto& task : helperTasks)
+			task.get();
+#endif
+		if (control->lines.size() == 0)
+			control->lines.push_back({control->bestMove, control->alpha});
+		/* Count nodes searched since the last poll */
+		for (unsigned i = 0; i < threads; i++)
+			control->nodes += workers[i]->pollChunk - workers[i]->nodesUntilPoll;
 
-	[[nodiscard]]
-	Score evalKing(Square square) const
+		if constexpr (enable_think_info)
+					 {
+						 state.positionsTransfered = 0;
+						 state.ttWriteConflicts = 0;
+						 state.lockWaits = 0;
+						 state.positionsEvaluated = 0;
+						 state.evalCacheHits = 0;
+						 std::chrono::nanoseconds sampledTime{0};
+						 unsigned samples = 0;
+						 for (unsigned i = 0; i < threads; i++)
+						 {
+							 state.positionsTransfered += workers[i]->state.positionsTransfered;
+							 state.ttWriteConflicts += workers[i]->state.ttWriteConflicts;
+							 state.lockWaits += workers[i]->state.lockWaits;
+							 state.positionsEvaluated += workers[i]->state.positionsEvaluated;
+							 state.evalCacheHits += workers[i]->evalStats.hits;
+							 sampledTime += workers[i]->evalStats.sampledTime;
+							 samples += workers[i]->evalStats.samples;
+							 workers[i]->publishStats();
+						 }
+						 state.stats = searchStats();
+						 state.evalTimeSaved = std::chrono::duration_cast<std::chrono::microseconds>(
+							 samples ? sampledTime * int64_t(state.evalCacheHits) / samples : sampledTime);
+					 }
+		state.depth = completedDepth;
+		state.time = timeManager.elapsed();
+		state.budget = timeManager.isEnabled() ? timeManager.hardLimit() : std::chrono::milliseconds(0);
+		state.budgetMet = !timeManager.isEnabled() || state.time <= state.budget;
+		return control->bestMove;
+	}
+
+#ifdef KAREN_ENABLE_PARALLEL
+	/**
+	 * @brief Search root moves with `i`th worker every time main thread asks to,
+	 * until search is finished.
+	 * Runs on one of pool's threads for whole search.
+	 */
+	void helpRoot(unsigned i)
 	{
-		Score score = INF;
-		constexpr sbyte evalTable[64] = {
-			0,   0,  -4,  -10, -10,  -4,   0,   0,
-			-4, -4,  -8,  -12, -12,  -8,  -4,  -4,
-			-12, -16, -20, -20, -20, -20, -16, -12,
-			-16, -20, -24, -24, -24, -24, -20, -16,
-			-16, -20, -24, -24, -24, -24, -20, -16,
-			-12, -16, -20, -20, -20, -20, -16, -12,
-			-4, -4,  -8,  -12, -12,  -8,  -4,  -4,
-			0,   0,  -4,  -10, -10,  -4,   0,   0,
-		};
-		score += evalTable[toByte(square)];
-		const auto x = getX(square);
-		const auto y = getY(square);
-		if (get<Color>(board[square]) == Color::WHITE)
+		SearchControl& c = *control;
+		/* Helper is counted out even if search throws, otherwise main thread would wait forever */
+		struct Exit
 		{
-			constexpr SquareEx shieldOffset[3] = {
-				{ byte(1), byte(1) },
-				{ byte(0), byte(1) },
-				{ byte(-1), byte(1) },
-			};
-			for (auto delta : shieldOffset)
+			SearchControl& c;
+			bool busy = false;
+			~Exit()
 			{
-				const auto newX = x + delta.x;
-				const auto newY = y + delta.y;
-				if (newX < 8 &&
-					newY < 8)
-				{
-					if (get<Color>(board[makeSquare(newX, newY)]) == Color::WHITE)
-						score += 8;
-				}
+				std::lock_guard lock(c.helperMutex);
+				c.helpersRunning--;
+				if (busy)
+					c.helpersBusy--;
+				c.helperDone.notify_all();
 			}
-		}
-		else
+		} exit{c};
+		unsigned job = 0;
+		while (true)
 		{
-			constexpr SquareEx shieldOffset[3] = {
-				{ byte(1), byte(-1) },
-				{ byte(0), byte(-1) },
-				{ byte(-1), byte(-1) },
-			};
-			for (auto delta : shieldOffset)
+			int depth;
 			{
-				const auto newX = x + delta.x;
-				const auto newY = y + delta.y;
-				if (newX < 8 &&
-					newY < 8)
-				{
-					if (get<Color>(board[makeSquare(newX, newY)]) == Color::WHITE)
-						score -= 8;
-				}
+				std::unique_lock lock(c.helperMutex);
+				c.helperWake.wait(lock, [&c, job] { return c.helpersQuit || c.helperJob != job; });
+				if (c.helpersQuit)
+					return;
+				job = c.helperJob;
+				depth = c.helperDepth;
+				exit.busy = true;
 			}
+			workers[i]->searchRootMoves(depth, false);
+			std::lock_guard lock(c.helperMutex);
+			exit.busy = false;
+			if (--c.helpersBusy == 0)
+				c.helperDone.notify_all();
 		}
-		return score;
 	}
 
-public:
-	class NoMovesAvailable : public std::logic_error
+	/**
+	 * @brief Make helpers search root moves to `depth` along with main thread.
+	 */
+	void startHelpers(int depth)
 	{
-		NoMovesAvailable(GameState state)
-			: std::logic_error("Engine::think: there're no moves available"),
-			  state(state) { }
-	public:
-		GameState state;
-
-		friend class Engine;
-	};	
+		{
+			std::lock_guard lock(control->helperMutex);
+			control->helperDepth = depth;
+			control->helperJob++;
+			control->helpersBusy = control->helpersRunning;
+		}
+		control->helperWake.notify_all();
+	}
 
-	[[nodiscard]]
-	Move think(int preferedDepth = 7)
+	/**
+	 * @brief Wait until helpers finish root search given by `startHelpers()`.
+	 */
+	void joinHelpers()
 	{
-		using namespace std::chrono;
-		
-		[[maybe_unused]]
-		auto now = steady_clock::now();
-		
-		if constexpr (enable_think_info)
-					 {
-						 state.positionsTransfered = 0;
-						 state.positionsEvaluated = 0;
-					 }
-
-		state.isCheck = isCheck(state.side);
-		
-		VectorOnStack<MoveEx, max_available_moves> moves;
-		genCaptures(moves);
-		genMoves(moves);
+		std::unique_lock lock(control->helperMutex);
+		control->helperDone.wait(lock, [this] { return control->helpersBusy == 0; });
+	}
 
-		bool moved = false;
-		const Color us = state.side;
-		
-		Score alpha = -INF * 2;
-		Score beta = INF * 2;
-		Move bestMove = makeMove(Square::A1, Square::A1);
+	/**
+	 * @brief Make helpers leave `helpRoot()` and wait for them.
+	 */
+	void stopHelpers()
+	{
+		std::unique_lock lock(control->helperMutex);
+		control->helpersQuit = true;
+		control->helperWake.notify_all();
+		control->helperDone.wait(lock, [this] { return control->helpersRunning == 0; });
+	}
+#endif
 
-		std::sort(moves.begin(), moves.end(), std::greater{}); /* Because we're iterating over
-																  all available moves we can
-																  order all that moves at once. */
+	/**
+	 * @brief Take root moves one by one and search them.
+	 * @param single return after the first move.
+	 */
+	void searchRootMoves(int depth, bool single)
+	{
+		const auto& moves = search->rootMoves;
+		const Score beta = INF * 2;
 
-		for (auto& [s, move] : moves)
+		for (unsigned i = search->nextRootMove++; i < moves.size(); i = search->nextRootMove++)
 		{
+			const Move move = moves[i].move;
+			const Score alpha = search->alpha.load();
+			trace(TraceEvent::ROOT_MOVE_BEGIN, depth, move);
 			auto st = doMove(move);
-			if (!isCheck(us))
+			Score score = -alphaBeta(-beta, -alpha, depth, 1);
+			undoMove(st);
+			trace(score > alpha ? TraceEvent::ROOT_MOVE_FAIL_HIGH : TraceEvent::ROOT_MOVE_FAIL_LOW,
+				  depth, move, score);
 			{
-				moved = true;
-				Score score = -alphaBeta(-beta, -alpha, preferedDepth, 1);
-				undoMove(st);
-				if (score > alpha)
+#ifdef KAREN_ENABLE_PARALLEL
+				std::unique_lock lock(search->bestMutex, std::try_to_lock);
+				if (!lock.owns_lock())
 				{
-					alpha = score;
-					bestMove = move;
+					if constexpr (enable_think_info)
+									 state.lockWaits++;
+					lock.lock();
+				}
+#endif
+				/* Even when search is stopped at least one move must be found */
+				const bool none = search->lineMove == makeMove(Square::A1, Square::A1);
+				if (none || (!aborted && score > search->alpha))
+				{
+					search->alpha = score;
+					search->lineMove = move;
+					search->lineComplete = !aborted;
 				}
 			}
-			else undoMove(st);
-		}
-		
-		if constexpr (enable_think_info)
-						 state.time = duration_cast<
-							 milliseconds>(steady_clock::now() - now);
-		if (!moved)
-		{
-			if (state.isCheck) throw NoMovesAvailable(GameState::MATE);
-			else throw NoMovesAvailable(GameState::DRAW);
+			if (single || aborted)
+				return;
 		}
-		return bestMove;
 	}
 
 }; /* class Engine */
@@ -2589,16 +6182,69 @@ public:
  */
 class Play
 {
+public:
+	/**
+	 * The longest think of karen in a game.
+	 */
+	struct SlowestThink
+	{
+		/* Number of karen's half move, history before it leads to the position */
+		unsigned halfMove = 0;
+		std::chrono::microseconds time{0};
+		uint64_t nodes = 0;
+	};
+
+	/**
+	 * Game clock.
+	 * Every side gets `base` time for `movesToGo` moves(or for whole game
+	 * when `movesToGo` is zero) and `increment` is added after every move.
+	 */
+	struct Clock
+	{
+		std::chrono::milliseconds base{std::chrono::minutes(5)};
+		std::chrono::milliseconds increment{0};
+		unsigned movesToGo = 0;
+	};
+
 private:
 	Engine karen;
 	std::vector<Move> movesHistory;
+	/* Time left on clocks, [0] -> white, [1] -> black */
+	std::chrono::milliseconds timeLeft[2] = {};
+	/* Move karen expects user to play while she's pondering */
+	Move ponderMove = makeMove(Square::A1, Square::A1);
+	std::shared_future<Move> ponderResult;
+	/* Durations of karen's thinks in microseconds and nodes they searched, for the last game */
+	Histogram thinkTimes;
+	Histogram thinkNodes;
+	SlowestThink slowest;
 
 protected:
 	const Color playerSide;
 	unsigned maxMoves = 50;
+	/* Number of threads karen thinks with */
+	unsigned threads = 1;
+	/* Karen thinks on expected move while user is thinking */
+	bool ponder = true;
 	
 	const Engine& engine() const noexcept { return karen; }
 
+	/**
+	 * @brief Set size of karen's transposition table in megabytes.
+	 */
+	void setHashSize(unsigned megabytes) { karen.setHashSize(megabytes); }
+
+	/**
+	 * @brief Make karen evaluate positions with neural network.
+	 */
+	void setNetwork(std::shared_ptr<const Network> network) { karen.setNetwork(std::move(network)); }
+
+	/**
+	 * @return move karen expects user to play or A1A1 when karen isn't pondering.
+	 */
+	[[nodiscard]]
+	Move expectedMove() const noexcept { return ponderMove; }
+
 	Play(const Board& board, Color playerSide)
 		: karen(board, Color::WHITE), playerSide(playerSide) {}
 	Play(Color playerSide)
@@ -2606,6 +6252,16 @@ protected:
 
 	auto& history() const { return movesHistory; }
 
+	/**
+	 * @return time left on `side`'s clock.
+	 * It is zero when game is played without clock.
+	 */
+	[[nodiscard]]
+	std::chrono::milliseconds clock(Color side) const noexcept
+	{
+		return timeLeft[side == Color::WHITE ? 0 : 1];
+	}
+
 	/**
 	 * Render a board.
 	 * This function called everytime board updated.
@@ -2642,27 +6298,138 @@ public:
 	};
 
 	/**
-	 * Play a chess game.
+	 * @return durations of karen's thinks in the last game in microseconds,
+	 * from her turn to her move.
+	 */
+	[[nodiscard]]
+	const Histogram& thinkTimeHistogram() const noexcept { return thinkTimes; }
+	/**
+	 * @return number of nodes of karen's thinks in the last game.
+	 */
+	[[nodiscard]]
+	const Histogram& thinkNodeHistogram() const noexcept { return thinkNodes; }
+	/**
+	 * @return the longest think of karen in the last game.
+	 */
+	[[nodiscard]]
+	const SlowestThink& slowestThink() const noexcept { return slowest; }
+
+	/**
+	 * Play a chess game, karen searches every move to `depth`.
 	 */
 	Result operator() (byte depth = 7)
 	{
+		Engine::Limits limits;
+		limits.depth = depth;
+		return play(limits, nullptr);
+	}
+
+	/**
+	 * Play a chess game with `clock`.
+	 * Side which runs out of time loses.
+	 */
+	Result operator() (const Clock& clock)
+	{
+		Engine::Limits limits;
+		limits.depth = Engine::max_ply;
+		return play(limits, &clock);
+	}
+
+private:
+	Result play(Engine::Limits limits, const Clock* clock)
+	{
+		using namespace std::chrono;
+
+		limits.threads = threads;
+		timeLeft[0] = timeLeft[1] = clock ? clock->base : milliseconds(0);
+		if (maxMoves > 0)
+			movesHistory.reserve(movesHistory.size() + 2 * maxMoves);
+		thinkTimes.clear();
+		thinkNodes.clear();
+		slowest = {};
+
+		/* Limits for karen's move which is `moveNo`-th half move */
+		const auto karenLimits = [&](unsigned moveNo) {
+			Engine::Limits result = limits;
+			if (clock)
+			{
+				const unsigned sideMoveNo = (moveNo - 1) / 2;
+				result.time = timeLeft[playerSide == Color::WHITE ? 1 : 0];
+				result.increment = clock->increment;
+				result.movesToGo = clock->movesToGo ?
+					clock->movesToGo - sideMoveNo % clock->movesToGo : 0;
+			}
+			return result;
+		};
+		bool ponderHit = false;
+
 		Color side = Color::WHITE;
 		for (unsigned moveNo = 1; !(maxMoves > 0 && moveNo > 2 * maxMoves); moveNo++)
 		{
+			const auto start = steady_clock::now();
+			/* Search writes karen's state when it's finished,
+			 * so it's not read until then. Waiting is karen's time */
+			if (ponderHit)
+				ponderResult.wait();
 			if (renderBoard(side))
 				return Result::NONE;
+			/* Number of move of `side` counting from 0 */
+			const unsigned sideMoveNo = (moveNo - 1) / 2;
+			auto& left = timeLeft[side == Color::WHITE ? 0 : 1];
 			Move move = makeMove(Square::A1, Square::A1);
 			if (side == playerSide)
 			{
+				if (ponder)
+					startPondering(karenLimits(moveNo + 1));
 				if (inputMove(move))
 					return Result::NONE;
+				if (ponderMove != makeMove(Square::A1, Square::A1))
+				{
+					if (move == ponderMove)
+					{
+						/* Karen's think starts now, search is finished at the top of next move */
+						karen.trace(TraceEvent::THINK_BEGIN, moveNo + 1);
+						karen.ponderhit();
+						ponderHit = true;
+					}
+					else /* search is useless, but transposition table is kept */
+					{
+						karen.stop();
+						karen.wait();
+					}
+					ponderMove = makeMove(Square::A1, Square::A1);
+				}
 			}
 			else
 			{
-				move = karen.think(depth);
+				if (!ponderHit)
+					karen.trace(TraceEvent::THINK_BEGIN, moveNo);
+				move = ponderHit ? ponderResult.get() : karen.startThink(karenLimits(moveNo)).get();
+				karen.trace(TraceEvent::THINK_END, moveNo, move);
+				ponderHit = false;
+				const auto time = duration_cast<microseconds>(steady_clock::now() - start);
+				thinkTimes.record(time.count());
+				thinkNodes.record(karen.nodesSearched());
+				if (time > slowest.time)
+					slowest = {moveNo, time, karen.nodesSearched()};
 			}
 			if (move == makeMove(Square::A1, Square::A1))
 				throw std::runtime_error("Play:: failed to get move :(");
+
+			if (clock)
+			{
+				left -= duration_cast<milliseconds>(steady_clock::now() - start);
+				if (left.count() < 0) /* flag fell */
+				{
+					left = milliseconds(0);
+					if (side == playerSide) gameOver();
+					else win();
+					return (side == Color::WHITE) ? Result::BLACK_WON : Result::WHITE_WON;
+				}
+				left += clock->increment;
+				if (clock->movesToGo && (sideMoveNo + 1) % clock->movesToGo == 0)
+					left += clock->base;
+			}
 			
 			karen.doMove(move);
 			side = !side;
@@ -2682,6 +6449,21 @@ public:
 		}
 		return Result::DRAW;
 	}
+
+	/**
+	 * @brief Start searching position after move that karen expects from user.
+	 */
+	void startPondering(Engine::Limits limits)
+	{
+		ponderMove = karen.hashMove();
+		if (ponderMove == makeMove(Square::A1, Square::A1))
+			return;
+		limits.ponder = true;
+		/* Search is done on copies so position can be restored right away */
+		auto info = karen.doMove(ponderMove);
+		ponderResult = karen.startThink(limits);
+		karen.undoMove(info);
+	}
 };
 
 } /* namespace karen11 */
@@ -0,0 +1,197 @@
+/**
+ * This file is part of Karen11.
+ *
+ * Karen11 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Karen11 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Karen11.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <array>
+#include <string>
+#include <cstring>
+#include <cerrno>
+#include <cstdint>
+
+#ifdef __linux__
+# include <linux/perf_event.h>
+# include <sys/ioctl.h>
+# include <sys/syscall.h>
+# include <unistd.h>
+#endif
+
+namespace karen11
+{
+
+/**
+ * Hardware performance counters of this process read with perf_event_open.
+ * See https://man7.org/linux/man-pages/man2/perf_event_open.2.html
+ * Threads created after counters are opened are counted too, so engines must
+ * start their searches after that. When kernel doesn't allow some counter
+ * (e.g. perf_event_paranoid is too high or there's no PMU in virtual machine)
+ * it's unavailable and everything else keeps working.
+ */
+class PerfCounters
+{
+public:
+	enum Event { CYCLES, INSTRUCTIONS, L1D_MISSES, LLC_MISSES, BRANCH_MISSES, DTLB_MISSES, EVENT_COUNT };
+
+	static constexpr const char* names[EVENT_COUNT] = {
+		"cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses", "dtlb_misses"
+	};
+
+	/* Counted events, negative for unavailable counters */
+	using Values = std::array<double, EVENT_COUNT>;
+
+	PerfCounters() noexcept
+	{
+		fds.fill(-1);
+#ifdef __linux__
+		const auto cache = [](uint64_t cache, uint64_t result) noexcept {
+			return cache | (uint64_t(PERF_COUNT_HW_CACHE_OP_READ) << 8) | (result << 16);
+		};
+		const std::pair<uint32_t, uint64_t> events[EVENT_COUNT] = {
+			{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+			{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+			{ PERF_TYPE_HW_CACHE, cache(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_RESULT_MISS) },
+			{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+			{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+			{ PERF_TYPE_HW_CACHE, cache(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_RESULT_MISS) },
+		};
+		for (unsigned i = 0; i < EVENT_COUNT; i++)
+		{
+			perf_event_attr attr;
+			std::memset(&attr, 0, sizeof(attr));
+			attr.size = sizeof(attr);
+			attr.type = events[i].first;
+			attr.config = events[i].second;
+			attr.disabled = 1;
+			attr.inherit = 1;
+			/* User space only, it's allowed with perf_event_paranoid up to 2 */
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			/* Counters are multiplexed when there're more events than hardware counters */
+			attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+			fds[i] = int(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+			if (fds[i] < 0 && errorMessage.empty())
+				errorMessage = std::string(names[i]) + ": " + std::strerror(errno);
+		}
+#else
+		errorMessage = "perf_event_open is available on Linux only";
+#endif
+	}
+
+	PerfCounters(const PerfCounters&) = delete;
+	PerfCounters& operator=(const PerfCounters&) = delete;
+
+	~PerfCounters() noexcept
+	{
+#ifdef __linux__
+		for (int fd : fds)
+			if (fd >= 0)
+				close(fd);
+#endif
+	}
+
+	/**
+	 * @return true if at least one counter is available.
+	 */
+	[[nodiscard]]
+	bool available() const noexcept
+	{
+		for (int fd : fds)
+			if (fd >= 0)
+				return true;
+		return false;
+	}
+
+	/**
+	 * @return why the first unavailable counter couldn't be opened, empty if all are available.
+	 */
+	[[nodiscard]]
+	const std::string& error() const noexcept
+	{
+		return errorMessage;
+	}
+
+	/**
+	 * @brief Set counted events to zero.
+	 */
+	void reset() noexcept
+	{
+#ifdef __linux__
+		control(PERF_EVENT_IOC_RESET);
+#endif
+	}
+
+	/**
+	 * @brief Start counting, events are added to ones counted before.
+	 * Enable counters only around measured code, so setup isn't counted.
+	 */
+	void enable() noexcept
+	{
+#ifdef __linux__
+		control(PERF_EVENT_IOC_ENABLE);
+#endif
+	}
+
+	/**
+	 * @brief Pause counting, values stay until `reset()`.
+	 */
+	void disable() noexcept
+	{
+#ifdef __linux__
+		control(PERF_EVENT_IOC_DISABLE);
+#endif
+	}
+
+	/**
+	 * @return events counted since `reset()`, scaled when counters were multiplexed.
+	 */
+	[[nodiscard]]
+	Values read() const noexcept
+	{
+		Values values;
+		values.fill(-1);
+#ifdef __linux__
+		for (unsigned i = 0; i < EVENT_COUNT; i++)
+		{
+			/* value, time enabled, time running */
+			uint64_t data[3];
+			if (fds[i] < 0 || ::read(fds[i], data, sizeof(data)) != ssize_t(sizeof(data)))
+				continue;
+			values[i] = data[2] ? double(data[0]) * double(data[1]) / double(data[2]) : 0.0;
+		}
+#endif
+		return values;
+	}
+
+private:
+#ifdef __linux__
+	/**
+	 * @brief Do ioctl `request` on every available counter.
+	 */
+	void control(unsigned long request) noexcept
+	{
+		for (int fd : fds)
+			if (fd >= 0)
+				ioctl(fd, request, 0);
+	}
+#endif
+
+	std::array<int, EVENT_COUNT> fds;
+	std::string errorMessage;
+};
+
+} /* namespace karen11 */
+
+/* PerfCounters.hpp ends here */
@@ -0,0 +1,651 @@
+/**
+ * This file is part of Karen11.
+ *
+ * Karen11 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Karen11 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Karen11.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Microbenchmarks of engine's hot paths.
+ * Every benchmark runs over a fixed set of opening, middlegame and endgame
+ * positions. After warmup it's repeated several times and mean time of
+ * one operation is reported with its deviation between repetitions.
+ * Heap allocations are counted by replaced `operator new`, with
+ * --allocations searches are checked not to allocate.
+ * With --verify-kernels kernels of every set this CPU supports are
+ * compared with scalar ones, with --deterministic deterministic searches
+ * are checked to be repeatable and with --analyze lines of multi-PV analysis
+ * are checked.
+ */
+#include "Karen.hpp"
+#include "BenchPositions.hpp"
+
+#include <iostream>
+#include <iomanip>
+#include <cmath>
+#include <cstdlib>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <new>
+#include <random>
+
+using namespace karen11;
+
+/* Allocations made by all threads and by threads other than main one, i.e. search threads */
+static std::atomic<uint64_t> allocations{0};
+static std::atomic<uint64_t> searchAllocations{0};
+static thread_local bool mainThread = false;
+
+static void* allocate(std::size_t size, std::size_t alignment)
+{
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	if (!mainThread)
+		searchAllocations.fetch_add(1, std::memory_order_relaxed);
+	size = std::max<std::size_t>(size, 1);
+	void* ptr = alignment > alignof(std::max_align_t) ?
+		std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment) : std::malloc(size);
+	if (!ptr)
+		throw std::bad_alloc();
+	return ptr;
+}
+
+void* operator new(std::size_t size) { return allocate(size, 0); }
+void* operator new[](std::size_t size) { return allocate(size, 0); }
+void* operator new(std::size_t size, std::align_val_t alignment) { return allocate(size, std::size_t(alignment)); }
+void* operator new[](std::size_t size, std::align_val_t alignment) { return allocate(size, std::size_t(alignment)); }
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::size_t, std::align_val_t) noexcept { std::free(ptr); }
+
+namespace
+{
+
+constexpr const char* phases[] = { "opening", "middlegame", "endgame" };
+
+/* Results are added here so compiler can't throw away benchmarked code */
+volatile uint64_t sink;
+
+/* Depth of searches done by "search" benchmark */
+constexpr int search_depth = 4;
+/* Small hash table so that clearing it before every search doesn't take longer than search */
+constexpr unsigned search_hash = 1;
+
+struct Options
+{
+	unsigned repetitions = 10;
+	/* Time of one repetition */
+	std::chrono::milliseconds time{100};
+	/* Run only benchmarks which name contains it */
+	std::string filter;
+	/* Check that searches don't allocate instead of running benchmarks */
+	bool allocations = false;
+	/* Compare kernels with scalar ones instead of running benchmarks */
+	bool verifyKernels = false;
+	/* Check that deterministic searches repeat instead of running benchmarks */
+	bool deterministic = false;
+	/* Check lines of `Engine::analyze()` instead of running benchmarks */
+	bool analyze = false;
+};
+
+/**
+ * Position that operations are done on.
+ */
+struct Subject
+{
+	std::unique_ptr<Engine> engine;
+	/* Pseudo-legal moves of position, generated before measuring */
+	VectorOnStack<Move, Engine::max_available_moves> moves;
+};
+
+/**
+ * Operation that is benchmarked.
+ * `run` does it on subject's position and returns number of operations done.
+ */
+struct Benchmark
+{
+	const char* name;
+	std::function<uint64_t(Subject&)> run;
+};
+
+struct Result
+{
+	/* Time of one operation in nanoseconds */
+	double mean;
+	double deviation;
+};
+
+/**
+ * @return time of one operation measured `repetitions` times.
+ */
+Result measure(const Benchmark& benchmark, std::vector<Subject*>& subjects, const Options& options)
+{
+	using Clock = std::chrono::steady_clock;
+	const auto pass = [&benchmark, &subjects]() {
+		uint64_t operations = 0;
+		for (Subject* subject : subjects)
+			operations += benchmark.run(*subject);
+		return operations;
+	};
+
+	/* Warmup finds number of passes that takes `options.time` */
+	uint64_t passes = 1;
+	for (;;)
+	{
+		const auto start = Clock::now();
+		for (uint64_t i = 0; i < passes; i++)
+			pass();
+		const auto elapsed = Clock::now() - start;
+		if (elapsed >= options.time / 4)
+		{
+			passes = std::max<uint64_t>(1, passes * options.time / elapsed);
+			break;
+		}
+		passes *= 2;
+	}
+
+	std::vector<double> times;
+	for (unsigned repetition = 0; repetition < options.repetitions; repetition++)
+	{
+		uint64_t operations = 0;
+		const auto start = Clock::now();
+		for (uint64_t i = 0; i < passes; i++)
+			operations += pass();
+		const std::chrono::duration<double, std::nano> elapsed = Clock::now() - start;
+		times.push_back(elapsed.count() / std::max<uint64_t>(operations, 1));
+	}
+
+	Result result{0, 0};
+	for (double time : times)
+		result.mean += time / times.size();
+	for (double time : times)
+		result.deviation += (time - result.mean) * (time - result.mean) / times.size();
+	result.deviation = std::sqrt(result.deviation);
+	return result;
+}
+
+/* Depth of searches checked by `checkAllocations()` */
+constexpr int allocation_depth = 6;
+
+/**
+ * @return network with random weights, it's written to temporary file as networks can only be loaded.
+ */
+std::shared_ptr<const Network> randomNetwork()
+{
+	const auto path = std::filesystem::temp_directory_path() / "karen_bench_network.knn";
+	{
+		std::ofstream file(path, std::ios::binary);
+		const uint32_t hidden = Network::hidden_size;
+		file.write("KNN1", 4);
+		file.write(reinterpret_cast<const char*>(&hidden), sizeof(hidden));
+		std::mt19937 random(11);
+		/* Feature weights and biases, output weights, output bias */
+		const size_t count = (Network::feature_count + 1) * Network::hidden_size + 2 * Network::hidden_size;
+		for (size_t i = 0; i < count; i++)
+		{
+			const int16_t weight = int16_t(int(random() % 33) - 16);
+			file.write(reinterpret_cast<const char*>(&weight), sizeof(weight));
+		}
+		const int32_t bias = 0;
+		file.write(reinterpret_cast<const char*>(&bias), sizeof(bias));
+	}
+	std::shared_ptr<const Network> network = Network::load(path.string());
+	std::filesystem::remove(path);
+	return network;
+}
+
+/**
+ * @brief Search every subject to depth 1 and then to `allocation_depth`,
+ * count heap allocations of the second search.
+ * @detail The first search lets engine allocate tables and start threads.
+ * Allocations done by `startThink()` for starting search threads are allowed,
+ * but search threads themselves mustn't allocate, with any number of threads
+ * and with evaluation by network as well.
+ * @return false if search allocated.
+ */
+bool checkAllocations(std::vector<Subject>& subjects)
+{
+	bool ok = true;
+	std::cout << std::left << std::setw(12) << "position" << std::setw(10) << "threads" << std::setw(10) << "network"
+			  << std::right << std::setw(12) << "nodes" << std::setw(14) << "allocs/think" << std::setw(16)
+			  << "search allocs" << std::setw(16) << "allocs/node" << "\n";
+#ifdef KAREN_ENABLE_PARALLEL
+	constexpr unsigned max_threads = 2;
+#else
+	constexpr unsigned max_threads = 1;
+#endif
+	const auto network = randomNetwork();
+	for (bool nnue : { false, true })
+	{
+		for (Subject& subject : subjects)
+		{
+			subject.engine->setNetwork(nnue ? network : nullptr);
+			/* Deterministic search clears hash table, entries of the previous pass would cut searches short */
+			Engine::Limits limits;
+			limits.depth = 1;
+			limits.deterministic = true;
+			(void)subject.engine->startThink(limits).get();
+		}
+		/* Searches with one thread clear hash table, so they go last */
+		for (unsigned threads = max_threads; threads >= 1; threads--)
+			for (size_t i = 0; i < subjects.size(); i++)
+			{
+				Engine& engine = *subjects[i].engine;
+				Engine::Limits limits;
+				limits.depth = 1;
+				limits.threads = threads;
+				limits.deterministic = threads == 1;
+				(void)engine.startThink(limits).get();
+
+				limits.depth = allocation_depth;
+				const uint64_t before = allocations, searchBefore = searchAllocations;
+				(void)engine.startThink(limits).get();
+				const uint64_t total = allocations - before, search = searchAllocations - searchBefore;
+				const uint64_t nodes = std::max<uint64_t>(engine.nodesSearched(), 1);
+				std::cout << std::left << std::setw(12) << benchPositions[i].phase << std::setw(10) << threads
+						  << std::setw(10) << (nnue ? "yes" : "no") << std::right
+						  << std::setw(12) << nodes << std::setw(14) << total << std::setw(16) << search
+						  << std::setw(16) << std::setprecision(6) << double(total) / nodes
+						  << (search ? "  FAILED" : "") << "\n";
+				if (search)
+					ok = false;
+			}
+	}
+	std::cout << (ok ? "Search doesn't allocate.\n" : "Search allocates on heap!\n");
+	return ok;
+}
+
+/* Depth of searches checked by `checkDeterminism()` */
+constexpr int determinism_depth = 6;
+
+/**
+ * @brief Search every subject with deterministic limits twice in a row and once more
+ * after a different search on the same engine.
+ * @detail Deterministic search must not depend on anything left by previous searches:
+ * hash table, eval cache, history or number of threads used before.
+ * @return false if node counts or best moves of these searches differ.
+ */
+bool checkDeterminism(std::vector<Subject>& subjects)
+{
+	bool ok = true;
+	std::cout << std::left << std::setw(12) << "position" << std::right << std::setw(8) << "move"
+			  << std::setw(12) << "nodes" << std::setw(12) << "again" << std::setw(12) << "after other" << "\n";
+	for (size_t i = 0; i < subjects.size(); i++)
+	{
+		Engine& engine = *subjects[i].engine;
+		Engine::Limits limits;
+		limits.depth = determinism_depth;
+		limits.deterministic = true;
+		const auto search = [&engine](const Engine::Limits& limits) {
+			const Move move = engine.startThink(limits).get();
+			return std::make_pair(move, engine.nodesSearched());
+		};
+
+		const auto first = search(limits);
+		const auto again = search(limits);
+		Engine::Limits other;
+		other.depth = determinism_depth - 1;
+#ifdef KAREN_ENABLE_PARALLEL
+		other.threads = 2;
+#endif
+		(void)engine.startThink(other).get();
+		const auto after = search(limits);
+
+		const bool same = again == first && after == first;
+		std::cout << std::left << std::setw(12) << benchPositions[i].phase << std::right
+				  << std::setw(8) << to_string(first.first) << std::setw(12) << first.second
+				  << std::setw(12) << again.second << std::setw(12) << after.second;
+		if (again.first != first.first || after.first != first.first)
+			std::cout << "  moves " << to_string(again.first) << ' ' << to_string(after.first);
+		std::cout << (same ? "" : "  FAILED") << "\n";
+		if (!same)
+			ok = false;
+	}
+	std::cout << (ok ? "Deterministic searches repeat.\n" : "Deterministic searches differ!\n");
+	return ok;
+}
+
+/* Depth and number of lines of analyses checked by `checkAnalysis()` */
+constexpr int analysis_depth = 5;
+constexpr unsigned analysis_lines = 3;
+
+/**
+ * @brief Analyze every subject with `analysis_lines` lines and compare them
+ * with deterministic single line search to the same depth.
+ * @return false unless every analysis returns distinct moves sorted by score,
+ * as many as there're lines or legal moves, the first one is the best move
+ * of single line search and every line's PV starts with its move.
+ */
+bool checkAnalysis(std::vector<Subject>& subjects)
+{
+	bool ok = true;
+	for (size_t i = 0; i < subjects.size(); i++)
+	{
+		Engine& engine = *subjects[i].engine;
+		Engine::Limits limits;
+		limits.depth = analysis_depth;
+		limits.deterministic = true;
+		const Move best = engine.startThink(limits).get();
+		limits.multiPV = analysis_lines;
+		const auto lines = engine.analyze(limits);
+
+		std::string error;
+		const size_t expected = std::min<size_t>(analysis_lines, engine.availableMoves(true).size());
+		if (lines.size() != expected)
+			error = std::to_string(lines.size()) + " lines instead of " + std::to_string(expected);
+		else if (lines[0].move != best)
+			error = "first line isn't best move " + to_string(best);
+		for (size_t j = 0; j < lines.size() && error.empty(); j++)
+		{
+			if (lines[j].pv.empty() || lines[j].pv[0] != lines[j].move)
+				error = "PV of line " + std::to_string(j + 1) + " doesn't start with its move";
+			else if (j > 0 && lines[j].score > lines[j - 1].score)
+				error = "line " + std::to_string(j + 1) + " scores more than line " + std::to_string(j);
+			for (size_t k = 0; k < j && error.empty(); k++)
+				if (lines[k].move == lines[j].move)
+					error = "lines " + std::to_string(k + 1) + " and " + std::to_string(j + 1) + " have same move";
+		}
+
+		std::cout << std::left << std::setw(12) << benchPositions[i].phase;
+		for (const auto& line : lines)
+			std::cout << ' ' << to_string(line.move) << ' ' << std::setw(6) << line.score;
+		std::cout << (error.empty() ? "" : "  FAILED: " + error) << "\n";
+		if (!error.empty())
+			ok = false;
+	}
+	std::cout << (ok ? "Analysis lines are consistent.\n" : "Analysis lines are wrong!\n");
+	return ok;
+}
+
+/* Number of random games played from every position for `verifyKernels()` */
+constexpr unsigned verify_games = 100;
+/* Length of these games in half moves */
+constexpr unsigned verify_plies = 80;
+
+/**
+ * @brief Compare every kernel of `tested` with scalar one on positions of random games
+ * played from `benchPositions`, on random occupancies and on random network accumulators.
+ * @return false if any result differs.
+ */
+bool verifyKernels(const Kernels& tested)
+{
+	const Kernels scalar = detail::scalarKernels();
+	std::mt19937_64 random(11);
+	uint64_t checked = 0, mismatches = 0;
+	const auto check = [&](bool equal, const char* kernel, const std::string& where) {
+		checked++;
+		if (!equal && mismatches++ < 10)
+			std::cout << tested.name << ' ' << kernel << " differs from scalar one " << where << "\n";
+	};
+	const auto checkSliders = [&](Bitboard occupied, const std::string& where) {
+		for (byte i = 0; i < 64; i++)
+		{
+			const Square square = static_cast<Square>(i);
+			check(tested.bishopAttacks(square, occupied) == scalar.bishopAttacks(square, occupied),
+				  "bishopAttacks", where + " at " + to_string(square));
+			check(tested.rookAttacks(square, occupied) == scalar.rookAttacks(square, occupied),
+				  "rookAttacks", where + " at " + to_string(square));
+		}
+	};
+
+	for (const auto& position : benchPositions)
+		for (unsigned game = 0; game < verify_games; game++)
+		{
+			Color side;
+			const Board start = parseFen(position.fen, side);
+			Engine engine(start, side);
+			for (unsigned ply = 0; ply < verify_plies; ply++)
+			{
+				const Board& board = engine.getBoard();
+				const std::string where = std::string("after ") + std::to_string(ply) + " random moves from '" +
+					position.fen + "'";
+				const BoardMasks masks = tested.boardMasks(board), expected = scalar.boardMasks(board);
+				check(std::memcmp(&masks, &expected, sizeof(masks)) == 0, "boardMasks", where);
+				check(tested.boardScore(board) == scalar.boardScore(board), "boardScore", where);
+				for (Color color : { Color::WHITE, Color::BLACK })
+					check(tested.sliderMobility(expected, color) == scalar.sliderMobility(expected, color),
+						  "sliderMobility", where);
+				if (game == 0)
+					checkSliders(expected.colors[0] | expected.colors[1], where);
+
+				const auto moves = engine.availableMoves(true);
+				if (moves.size() == 0)
+					break;
+				(void)engine.doMove(moves[random() % moves.size()]);
+			}
+		}
+
+	for (unsigned i = 0; i < 10000; i++)
+	{
+		/* Sparse and dense occupancies */
+		const Bitboard occupied = (i % 2) ? random() & random() : random() | random();
+		checkSliders(occupied, "with occupancy " + std::to_string(occupied));
+	}
+
+	/* Values are small enough not to overflow int16_t */
+	const auto accumulator = std::make_unique<Network::Accumulator>();
+	const auto weights = std::make_unique<Network::Accumulator>();
+	const auto expected = std::make_unique<Network::Accumulator>();
+	int16_t* values = accumulator->values[0];
+	constexpr unsigned count = Network::hidden_size;
+	for (unsigned i = 0; i < 1000; i++)
+	{
+		const std::string where = "on random vectors " + std::to_string(i);
+		for (unsigned j = 0; j < count; j++)
+		{
+			values[j] = int16_t(int(random() % 16001) - 8000);
+			weights->values[0][j] = int16_t(int(random() % 16001) - 8000);
+		}
+		std::copy(values, values + count, expected->values[0]);
+		tested.addWeights(values, weights->values[0], count);
+		scalar.addWeights(expected->values[0], weights->values[0], count);
+		check(std::equal(values, values + count, expected->values[0]), "addWeights", where);
+		tested.subWeights(values, weights->values[0], count);
+		scalar.subWeights(expected->values[0], weights->values[0], count);
+		check(std::equal(values, values + count, expected->values[0]), "subWeights", where);
+		/* Activations are spread around [0..max] to test clamping */
+		for (unsigned j = 0; j < count; j++)
+		{
+			values[j] = int16_t(int(random() % 512) - 192);
+			weights->values[0][j] = int16_t(int(random() % 4001) - 2000);
+		}
+		check(tested.clippedDot(values, weights->values[0], count, Network::activation_max) ==
+			  scalar.clippedDot(values, weights->values[0], count, Network::activation_max), "clippedDot", where);
+	}
+
+	std::cout << tested.name << " kernels: " << checked << " checks, " << mismatches << " mismatches.\n";
+	return mismatches == 0;
+}
+
+void printHelp()
+{
+	std::cout << "Usage: karen_bench [options]\n"
+		"Options:\n"
+		"--repetitions=<n>  number of measured repetitions, 10 by default\n"
+		"--time=<ms>        time of one repetition, 100 by default\n"
+		"--filter=<name>    run only benchmarks which name contains <name>\n"
+		"--allocations      check that searches don't allocate on heap, exit code\n"
+		"                   is 1 if they do\n"
+		"--verify-kernels   check that kernels of every set this CPU supports give\n"
+		"                   same results as scalar ones, exit code is 1 if they don't\n"
+		"--deterministic    check that deterministic searches give same nodes and\n"
+		"                   best moves when repeated, exit code is 1 if they don't\n"
+		"--analyze          check that multi-PV analysis returns distinct moves sorted\n"
+		"                   by score, the first being best move of single line search,\n"
+		"                   exit code is 1 if it doesn't\n";
+}
+
+/**
+ * @return false if program must exit.
+ */
+bool parseOptions(int argc, char** argv, Options& options)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		const std::string option = argv[i];
+		const auto value = [&option]() { return option.substr(option.find('=') + 1); };
+		try
+		{
+			if (option == "--help")
+			{
+				printHelp();
+				return false;
+			}
+			else if (option.find("--repetitions=") == 0)
+				options.repetitions = std::max(std::stoul(value()), 1ul);
+			else if (option.find("--time=") == 0)
+				options.time = std::chrono::milliseconds(std::max(std::stoul(value()), 1ul));
+			else if (option.find("--filter=") == 0)
+				options.filter = value();
+			else if (option == "--allocations")
+				options.allocations = true;
+			else if (option == "--verify-kernels")
+				options.verifyKernels = true;
+			else if (option == "--deterministic")
+				options.deterministic = true;
+			else if (option == "--analyze")
+				options.analyze = true;
+			else
+			{
+				std::cerr << "Unknown option '" << option << "', see --help\n";
+				return false;
+			}
+		}
+		catch (const std::exception&)
+		{
+			std::cerr << "Wrong value of '" << option << "'\n";
+			return false;
+		}
+	}
+	return true;
+}
+
+} /* namespace */
+
+int main(int argc, char** argv)
+{
+	mainThread = true;
+	Options options;
+	if (!parseOptions(argc, argv, options))
+		return 1;
+
+	const Benchmark benchmarks[] = {
+		{ "doMove+undoMove", [](Subject& subject) -> uint64_t {
+			Engine& engine = *subject.engine;
+			for (Move move : subject.moves)
+			{
+				const auto undo = engine.doMove(move);
+				sink = sink + engine.getState().hash;
+				engine.undoMove(undo);
+			}
+			return subject.moves.size();
+		} },
+		{ "genMoves", [](Subject& subject) -> uint64_t {
+			VectorOnStack<MoveEx, Engine::max_available_moves> moves;
+			subject.engine->genMoves(moves);
+			sink = sink + moves.size();
+			return 1;
+		} },
+		{ "genCaptures", [](Subject& subject) -> uint64_t {
+			VectorOnStack<MoveEx, Engine::max_available_moves> moves;
+			subject.engine->genCaptures(moves);
+			sink = sink + moves.size();
+			return 1;
+		} },
+		{ "isAtacked", [](Subject& subject) -> uint64_t {
+			uint64_t attacked = 0;
+			for (byte square = 0; square < 64; square++)
+				attacked += subject.engine->isAtacked(static_cast<Square>(square), Color::WHITE) +
+					subject.engine->isAtacked(static_cast<Square>(square), Color::BLACK);
+			sink = sink + attacked;
+			return 128;
+		} },
+		{ "evaluate", [](Subject& subject) -> uint64_t {
+			sink = sink + subject.engine->evaluate();
+			return 1;
+		} },
+		{ "availableMoves", [](Subject& subject) -> uint64_t {
+			sink = sink + subject.engine->availableMoves(true).size();
+			return 1;
+		} },
+		/* Time of one node, compare builds with different KAREN_INSTRUMENTATION
+		 * to see cost of instrumentation */
+		{ "search", [](Subject& subject) -> uint64_t {
+			Engine::Limits limits;
+			limits.depth = search_depth;
+			limits.deterministic = true;
+			sink = sink + static_cast<uint16_t>(subject.engine->startThink(limits).get());
+			return subject.engine->nodesSearched();
+		} },
+	};
+
+	std::vector<Subject> subjects;
+	for (const auto& position : benchPositions)
+	{
+		Color side;
+		const Board board = parseFen(position.fen, side);
+		Subject& subject = subjects.emplace_back();
+		subject.engine = std::make_unique<Engine>(board, side);
+		subject.engine->setHashSize(search_hash);
+		subject.moves = subject.engine->availableMoves(false);
+	}
+
+	if (options.allocations)
+		return checkAllocations(subjects) ? 0 : 1;
+	if (options.deterministic)
+		return checkDeterminism(subjects) ? 0 : 1;
+	if (options.analyze)
+		return checkAnalysis(subjects) ? 0 : 1;
+	if (options.verifyKernels)
+	{
+		/* Every set this CPU supports, not only the selected one, the first set is scalar */
+		const auto sets = detail::supportedKernels();
+		bool ok = true;
+		for (size_t i = 1; i < sets.size(); i++)
+			ok = verifyKernels(sets[i]) && ok;
+		if (sets.size() == 1)
+			std::cout << "Only scalar kernels are compiled.\n";
+		return ok ? 0 : 1;
+	}
+
+	constexpr const char* levels[] = { "none", "counters", "tracing" };
+	std::cout << "Using " << kernels.name << " kernels, " << levels[static_cast<int>(instrumentation)]
+			  << " instrumentation, " << options.repetitions << " repetitions of " << options.time.count() << " ms.\n"
+			  << std::left << std::setw(18) << "benchmark" << std::setw(12) << "positions"
+			  << std::right << std::setw(12) << "ns/op" << std::setw(10) << "+-%" << std::setw(14) << "ops/s" << "\n";
+	std::cout << std::fixed;
+	for (const auto& benchmark : benchmarks)
+	{
+		if (std::string_view(benchmark.name).find(options.filter) == std::string_view::npos)
+			continue;
+		for (const char* phase : phases)
+		{
+			std::vector<Subject*> group;
+			for (size_t i = 0; i < subjects.size(); i++)
+				if (std::string_view(benchPositions[i].phase) == phase)
+					group.push_back(&subjects[i]);
+			const Result result = measure(benchmark, group, options);
+			std::cout << std::left << std::setw(18) << benchmark.name << std::setw(12) << phase << std::right
+					  << std::setw(12) << std::setprecision(1) << result.mean
+					  << std::setw(10) << std::setprecision(2) << 100 * result.deviation / result.mean
+					  << std::setw(14) << std::setprecision(0) << 1e9 / result.mean << "\n";
+		}
+	}
+	return 0;
+}
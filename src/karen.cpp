@@ -7,7 +7,10 @@ int main(int argc, char** argv)
 	if (ConsolePlay::parseOptions(argc, argv))
 		return 0;
 	ConsolePlay play;
-	play(9);
+	if (ConsolePlay::depth)
+		play(ConsolePlay::depth);
+	else
+		play(ConsolePlay::timeControl);
 
 	return 0;
 }
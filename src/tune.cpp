@@ -0,0 +1,587 @@
+/**
+ * This file is part of Karen11.
+ *
+ * Karen11 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Karen11 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Karen11.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Tunes `EvalWeights` with Texel's method.
+ * See https://www.chessprogramming.org/Texel%27s_Tuning_Method
+ * Every labeled position is resolved to a quiet one by `Engine::resolveCaptures()`,
+ * its evaluation is split into a linear function of weights and the rest.
+ * Weights minimize mean squared difference between game results and
+ * sigmoid(K * evaluation) and are written as a header that karen can be built with.
+ */
+#include "Karen.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <thread>
+
+using namespace karen11;
+using namespace std::literals;
+
+namespace
+{
+
+constexpr size_t weight_count = sizeof(EvalWeights) / sizeof(ScorePair);
+
+/* Index of the first weight of `member` when `EvalWeights` is seen as array of `ScorePair` */
+#define KAREN_WEIGHT(member) (offsetof(EvalWeights, member) / sizeof(ScorePair))
+
+/**
+ * Weight `index` is counted `count` times for white minus times for black.
+ */
+struct Coefficient
+{
+	uint16_t index;
+	int16_t count;
+};
+
+struct Sample
+{
+	/* Game result from white's point of view */
+	float result;
+	/* Part of evaluation which doesn't depend on weights */
+	float rest;
+	byte phase;
+	uint16_t size;
+};
+
+/**
+ * Positions loaded by one thread, it computes their gradient as well.
+ */
+struct Shard
+{
+	std::vector<Sample> samples;
+	/* Coefficients of all samples one after another */
+	std::vector<Coefficient> coefficients;
+	std::vector<double> gradient;
+	unsigned malformed = 0;
+	unsigned skipped = 0;
+};
+
+/* [weight] x [middlegame, endgame] */
+using Weights = std::vector<double>;
+
+struct Options
+{
+	std::string positions;
+	std::string output = "eval_weights.hpp";
+	unsigned threads = std::max(std::thread::hardware_concurrency(), 1u);
+	unsigned epochs = 1000;
+	double rate = 1.0;
+	/* Found from positions when zero */
+	double k = 0;
+};
+
+void printHelp()
+{
+	std::cout << "Usage: karen_tune <positions> [options]\n"
+		"Every line of <positions> is FEN followed by game result: 1-0, 0-1, 1/2-1/2 or [1.0], [0.5], [0.0].\n"
+		"Options:\n"
+		"--output=<file>   header to write weights to, eval_weights.hpp by default\n"
+		"--threads=<n>     number of threads, all cores by default\n"
+		"--epochs=<n>      number of gradient descent steps, 1000 by default\n"
+		"--rate=<r>        learning rate in centipawns, 1.0 by default\n"
+		"--k=<k>           scaling of evaluation in sigmoid, found from positions by default\n"
+		"Build karen with -DKAREN_EVAL_WEIGHTS=<absolute path of output> to use tuned weights.\n";
+}
+
+/**
+ * @return false if program must exit.
+ */
+bool parseOptions(int argc, char** argv, Options& options)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		const std::string option = argv[i];
+		const auto value = [&option]() { return option.substr(option.find('=') + 1); };
+		try
+		{
+			if (option == "--help")
+			{
+				printHelp();
+				return false;
+			}
+			else if (option.find("--output=") == 0)
+				options.output = value();
+			else if (option.find("--threads=") == 0)
+				options.threads = std::max(std::stoul(value()), 1ul);
+			else if (option.find("--epochs=") == 0)
+				options.epochs = std::stoul(value());
+			else if (option.find("--rate=") == 0)
+				options.rate = std::stod(value());
+			else if (option.find("--k=") == 0)
+				options.k = std::stod(value());
+			else if (option.find("--") != 0 && options.positions.empty())
+				options.positions = option;
+			else
+			{
+				std::cerr << "Unknown option '" << option << "', see --help\n";
+				return false;
+			}
+		}
+		catch (const std::exception&)
+		{
+			std::cerr << "Wrong value of '" << option << "'\n";
+			return false;
+		}
+	}
+	if (options.positions.empty())
+	{
+		printHelp();
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Find game result written after FEN in `line`.
+ * Board field of FEN is skipped, its ranks like "k1/2p" look like results.
+ */
+bool parseResult(std::string_view line, float& result)
+{
+	const auto board = line.find_first_not_of(" \t");
+	if (board == line.npos)
+		return false;
+	const auto fields = line.find_first_of(" \t", board);
+	if (fields == line.npos)
+		return false;
+	line.remove_prefix(fields);
+	if (line.find("1/2") != line.npos)
+		result = 0.5f;
+	else if (line.find("1-0") != line.npos)
+		result = 1.0f;
+	else if (line.find("0-1") != line.npos)
+		result = 0.0f;
+	else if (auto bracket = line.find('['); bracket != line.npos)
+	{
+		const std::string number(line.substr(bracket + 1, line.find(']', bracket) - bracket - 1));
+		char* end;
+		result = std::strtof(number.c_str(), &end);
+		return end != number.c_str() && result >= 0.0f && result <= 1.0f;
+	}
+	else return false;
+	return true;
+}
+
+/**
+ * @return evaluation of `sample` from white's point of view.
+ */
+double evaluate(const Sample& sample, const Coefficient* coefficients, const Weights& weights) noexcept
+{
+	double middlegame = 0, endgame = 0;
+	for (unsigned i = 0; i < sample.size; i++)
+	{
+		middlegame += coefficients[i].count * weights[2 * coefficients[i].index];
+		endgame += coefficients[i].count * weights[2 * coefficients[i].index + 1];
+	}
+	return (middlegame * sample.phase + endgame * (MIDDLEGAME_PHASE - sample.phase)) / MIDDLEGAME_PHASE +
+		sample.rest;
+}
+
+/**
+ * @return expected result of game with evaluation `score`.
+ */
+double sigmoid(double k, double score) noexcept
+{
+	return 1.0 / (1.0 + std::pow(10.0, -k * score / 400.0));
+}
+
+/**
+ * @brief Resolve and split evaluation of `lines` in [`begin`, `end`).
+ */
+void load(Shard& shard, const std::vector<std::string_view>& lines, size_t begin, size_t end,
+		  const Weights& weights)
+{
+	Engine engine(Board::standard(), Color::WHITE);
+	MaterialTable materialTable;
+	std::vector<int> counts(weight_count);
+	std::vector<uint16_t> used;
+	const auto add = [&counts, &used](size_t index, int count) {
+		if (counts[index] == 0)
+			used.push_back(uint16_t(index));
+		counts[index] += count;
+	};
+
+	for (size_t i = begin; i < end; i++)
+	{
+		Sample sample;
+		Color side;
+		Board board;
+		if (!parseResult(lines[i], sample.result))
+		{
+			shard.malformed++;
+			continue;
+		}
+		try
+		{
+			board = parseFen(lines[i], side);
+		}
+		catch (const std::invalid_argument&)
+		{
+			shard.malformed++;
+			continue;
+		}
+		engine.setBoard(board, side);
+		/* Side to move can't stand pat in check */
+		if (engine.isCheck(Color::WHITE) || engine.isCheck(Color::BLACK))
+		{
+			shard.skipped++;
+			continue;
+		}
+		engine.resolveCaptures();
+
+		/* Endgame functions and scaling aren't linear in weights */
+		const auto& state = engine.getState();
+		const MaterialTable::Entry* material = materialTable.probe(state.materialKey);
+		if (!material)
+			material = &materialTable.store(state.materialKey, state.pieceCount);
+		if (material->endgame || material->draw ||
+			material->scale[0] != MaterialTable::normal_scale ||
+			material->scale[1] != MaterialTable::normal_scale)
+		{
+			shard.skipped++;
+			continue;
+		}
+
+		const Board& leaf = engine.getBoard();
+		for (byte square = 0; square < 64; square++)
+		{
+			const Piece piece = leaf[static_cast<Square>(square)];
+			if (piece == Piece::EMPTY)
+				continue;
+			const byte code = toByte(get<Code>(piece));
+			const bool white = get<Color>(piece) == Color::WHITE;
+			add(KAREN_WEIGHT(material) + code, white ? 1 : -1);
+			add(KAREN_WEIGHT(pieceSquares) + code * 64 + (white ? square : square ^ 56), white ? 1 : -1);
+		}
+
+		const BoardMasks masks = boardMasks(leaf);
+		PawnTable::Entry pawnEntry;
+		const PawnTable::Terms pawns = PawnTable::countTerms(pawnEntry, masks.pieces(Color::WHITE, Code::PAWN),
+															  masks.pieces(Color::BLACK, Code::PAWN));
+		const MaterialTable::Terms imbalance = MaterialTable::countTerms(state.pieceCount);
+		for (byte index = 0; index < 2; index++)
+		{
+			const int sign = index ? -1 : 1;
+			const Color color = index ? Color::BLACK : Color::WHITE;
+			add(KAREN_WEIGHT(doubledPawn), sign * pawns.doubled[index]);
+			add(KAREN_WEIGHT(isolatedPawn), sign * pawns.isolated[index]);
+			add(KAREN_WEIGHT(backwardPawn), sign * pawns.backward[index]);
+			for (byte rank = 0; rank < 8; rank++)
+				add(KAREN_WEIGHT(passedPawn) + rank, sign * pawns.passed[index][rank]);
+			add(KAREN_WEIGHT(bishopPair), sign * imbalance.bishopPair[index]);
+			add(KAREN_WEIGHT(noPawns), sign * imbalance.noPawns[index]);
+			add(KAREN_WEIGHT(knightPawn), sign * imbalance.knightPawns[index]);
+			add(KAREN_WEIGHT(noShortCastling), sign * !engine.shortCastlingAvailable(color));
+			add(KAREN_WEIGHT(noLongCastling), sign * !engine.longCastlingAvailable(color));
+		}
+
+		const size_t first = shard.coefficients.size();
+		for (uint16_t index : used)
+		{
+			if (counts[index] != 0)
+				shard.coefficients.push_back({index, int16_t(counts[index])});
+			counts[index] = 0;
+		}
+		used.clear();
+		sample.size = uint16_t(shard.coefficients.size() - first);
+		sample.phase = std::min(state.phase, MIDDLEGAME_PHASE);
+		sample.rest = 0;
+
+		const Score score = engine.evaluate();
+		sample.rest = float((state.side == Color::WHITE ? score : -score) -
+							evaluate(sample, &shard.coefficients[first], weights));
+		shard.samples.push_back(sample);
+	}
+}
+
+/**
+ * @brief Add gradient of squared error of `shard` to its `gradient`.
+ * @return sum of squared errors.
+ */
+double computeGradient(Shard& shard, const Weights& weights, double k)
+{
+	std::fill(shard.gradient.begin(), shard.gradient.end(), 0.0);
+	const Coefficient* coefficients = shard.coefficients.data();
+	double error = 0;
+	for (const Sample& sample : shard.samples)
+	{
+		const double expected = sigmoid(k, evaluate(sample, coefficients, weights));
+		const double difference = expected - sample.result;
+		error += difference * difference;
+		/* Constant factors are left to learning rate */
+		const double slope = difference * expected * (1 - expected);
+		const double middlegame = slope * sample.phase / MIDDLEGAME_PHASE;
+		const double endgame = slope - middlegame;
+		for (unsigned i = 0; i < sample.size; i++)
+		{
+			shard.gradient[2 * coefficients[i].index] += middlegame * coefficients[i].count;
+			shard.gradient[2 * coefficients[i].index + 1] += endgame * coefficients[i].count;
+		}
+		coefficients += sample.size;
+	}
+	return error;
+}
+
+/**
+ * @return mean squared error of all positions.
+ */
+double computeError(ThreadPool& pool, std::vector<Shard>& shards, const Weights& weights, double k)
+{
+	std::vector<std::future<double>> errors;
+	for (auto& shard : shards)
+		errors.push_back(pool.submit([&shard, &weights, k] {
+			const Coefficient* coefficients = shard.coefficients.data();
+			double error = 0;
+			for (const Sample& sample : shard.samples)
+			{
+				const double difference = sigmoid(k, evaluate(sample, coefficients, weights)) - sample.result;
+				error += difference * difference;
+				coefficients += sample.size;
+			}
+			return error;
+		}));
+	double error = 0;
+	size_t count = 0;
+	for (size_t i = 0; i < shards.size(); i++)
+	{
+		error += errors[i].get();
+		count += shards[i].samples.size();
+	}
+	return error / std::max<size_t>(count, 1);
+}
+
+/**
+ * @brief Find `k` that makes evaluation predict results best, golden section search is used.
+ */
+double fitK(ThreadPool& pool, std::vector<Shard>& shards, const Weights& weights)
+{
+	const double ratio = (std::sqrt(5.0) - 1) / 2;
+	double low = 0.0, high = 4.0;
+	double a = high - ratio * (high - low), b = low + ratio * (high - low);
+	double errorA = computeError(pool, shards, weights, a), errorB = computeError(pool, shards, weights, b);
+	while (high - low > 1e-3)
+	{
+		if (errorA < errorB)
+		{
+			high = b;
+			b = a, errorB = errorA;
+			a = high - ratio * (high - low);
+			errorA = computeError(pool, shards, weights, a);
+		}
+		else
+		{
+			low = a;
+			a = b, errorA = errorB;
+			b = low + ratio * (high - low);
+			errorB = computeError(pool, shards, weights, b);
+		}
+	}
+	return (low + high) / 2;
+}
+
+/**
+ * @brief Minimize error with Adam. See https://arxiv.org/abs/1412.6980
+ */
+void tune(ThreadPool& pool, std::vector<Shard>& shards, Weights& weights, const Options& options)
+{
+	constexpr double beta1 = 0.9, beta2 = 0.999, epsilon = 1e-8;
+	std::vector<double> moment(weights.size()), velocity(weights.size()), gradient(weights.size());
+	const auto start = std::chrono::steady_clock::now();
+
+	for (unsigned epoch = 1; epoch <= options.epochs; epoch++)
+	{
+		std::vector<std::future<double>> errors;
+		for (auto& shard : shards)
+			errors.push_back(pool.submit([&shard, &weights, &options] {
+				return computeGradient(shard, weights, options.k);
+			}));
+		double error = 0;
+		size_t count = 0;
+		std::fill(gradient.begin(), gradient.end(), 0.0);
+		for (size_t i = 0; i < shards.size(); i++)
+		{
+			error += errors[i].get();
+			count += shards[i].samples.size();
+			for (size_t j = 0; j < gradient.size(); j++)
+				gradient[j] += shards[i].gradient[j];
+		}
+
+		const double correction1 = 1 - std::pow(beta1, epoch), correction2 = 1 - std::pow(beta2, epoch);
+		for (size_t j = 0; j < weights.size(); j++)
+		{
+			const double g = gradient[j] / count;
+			moment[j] = beta1 * moment[j] + (1 - beta1) * g;
+			velocity[j] = beta2 * velocity[j] + (1 - beta2) * g * g;
+			weights[j] -= options.rate * (moment[j] / correction1) /
+				(std::sqrt(velocity[j] / correction2) + epsilon);
+		}
+
+		if (epoch % 50 == 0 || epoch == options.epochs)
+		{
+			const auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			std::cout << "Epoch " << epoch << ": error " << error / count << ", " << seconds << "s\n";
+		}
+	}
+}
+
+/**
+ * @brief Write `weights` as definition of `evalWeights`.
+ */
+void writeHeader(std::ostream& out, const Weights& weights, const Options& options, size_t positions)
+{
+	const auto score = [&weights](size_t index) {
+		return "makeScore(" + std::to_string(std::lround(weights[2 * index])) + ", " +
+			std::to_string(std::lround(weights[2 * index + 1])) + ")";
+	};
+	/* Elements are written `row` per line with `indent`, closing brace is indented one tab less */
+	const auto list = [&score](size_t index, size_t count, const std::string& indent, size_t row) {
+		std::string text = "{";
+		for (size_t i = 0; i < count; i++)
+		{
+			text += (i % row == 0) ? "\n" + indent : " "s;
+			text += score(index + i) + ",";
+		}
+		return text + "\n" + indent.substr(1) + "}";
+	};
+
+	out << "/* Evaluation weights written by karen_tune from " << options.positions << ", "
+		<< positions << " positions, K = " << options.k << ".\n"
+		<< " * Build karen with -DKAREN_EVAL_WEIGHTS=<path to this file> to use them. */\n"
+		<< "inline constexpr EvalWeights evalWeights = {\n"
+		<< "\t/* material */\n"
+		<< "\t" << list(KAREN_WEIGHT(material), 7, "\t\t", 7) << ",\n"
+		<< "\t/* pieceSquares */\n"
+		<< "\t{\n";
+	for (size_t code = 0; code < 7; code++)
+		out << "\t\t" << list(KAREN_WEIGHT(pieceSquares) + code * 64, 64, "\t\t\t", 8) << ",\n";
+	out << "\t},\n";
+
+	const struct
+	{
+		const char* name;
+		size_t index;
+		size_t count;
+	} fields[] = {
+		{ "doubledPawn", KAREN_WEIGHT(doubledPawn), 1 },
+		{ "isolatedPawn", KAREN_WEIGHT(isolatedPawn), 1 },
+		{ "backwardPawn", KAREN_WEIGHT(backwardPawn), 1 },
+		{ "passedPawn", KAREN_WEIGHT(passedPawn), 8 },
+		{ "bishopPair", KAREN_WEIGHT(bishopPair), 1 },
+		{ "noPawns", KAREN_WEIGHT(noPawns), 1 },
+		{ "knightPawn", KAREN_WEIGHT(knightPawn), 1 },
+		{ "noShortCastling", KAREN_WEIGHT(noShortCastling), 1 },
+		{ "noLongCastling", KAREN_WEIGHT(noLongCastling), 1 },
+	};
+	for (const auto& [name, index, count] : fields)
+		out << "\t/* " << name << " */\n\t"
+			<< (count == 1 ? score(index) : list(index, count, "\t\t", 4)) << ",\n";
+	out << "};\n";
+}
+
+} /* namespace */
+
+int main(int argc, char** argv)
+{
+	static_assert(weight_count * sizeof(ScorePair) == sizeof(EvalWeights),
+				  "EvalWeights must consist of ScorePair only");
+
+	Options options;
+	if (!parseOptions(argc, argv, options))
+		return 1;
+
+	std::ifstream file(options.positions, std::ios::binary);
+	if (!file)
+	{
+		std::cerr << "Can't open '" << options.positions << "'\n";
+		return 1;
+	}
+	std::stringstream buffer;
+	buffer << file.rdbuf();
+	const std::string text = buffer.str();
+	std::vector<std::string_view> lines;
+	for (size_t begin = 0; begin < text.size();)
+	{
+		size_t end = text.find('\n', begin);
+		if (end == text.npos)
+			end = text.size();
+		if (end > begin)
+			lines.push_back(std::string_view(text).substr(begin, end - begin));
+		begin = end + 1;
+	}
+
+	/* Weights compiled into this program are the starting point */
+	ScorePair initial[weight_count];
+	std::memcpy(initial, &evalWeights, sizeof(initial));
+	Weights weights(2 * weight_count);
+	for (size_t i = 0; i < weight_count; i++)
+	{
+		weights[2 * i] = middlegameScore(initial[i]);
+		weights[2 * i + 1] = endgameScore(initial[i]);
+	}
+
+	ThreadPool pool;
+	pool.reserve(options.threads);
+	std::vector<Shard> shards(options.threads);
+	{
+		const auto start = std::chrono::steady_clock::now();
+		std::vector<std::future<void>> loading;
+		for (size_t i = 0; i < shards.size(); i++)
+			loading.push_back(pool.submit([&, i] {
+				load(shards[i], lines, lines.size() * i / shards.size(),
+					 lines.size() * (i + 1) / shards.size(), weights);
+				shards[i].gradient.resize(weights.size());
+			}));
+		for (auto& future : loading)
+			future.get();
+
+		size_t positions = 0, malformed = 0, skipped = 0;
+		for (const auto& shard : shards)
+		{
+			positions += shard.samples.size();
+			malformed += shard.malformed;
+			skipped += shard.skipped;
+		}
+		const auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		std::cout << "Loaded " << positions << " positions in " << seconds << "s, skipped "
+				  << skipped << " not evaluated linearly and " << malformed << " malformed lines\n";
+		if (positions == 0)
+			return 1;
+	}
+
+	if (options.k == 0)
+		options.k = fitK(pool, shards, weights);
+	std::cout << "K = " << options.k << ", initial error " << computeError(pool, shards, weights, options.k) << "\n";
+	tune(pool, shards, weights, options);
+
+	std::ofstream out(options.output);
+	size_t positions = 0;
+	for (const auto& shard : shards)
+		positions += shard.samples.size();
+	writeHeader(out, weights, options, positions);
+	if (!out)
+	{
+		std::cerr << "Can't write '" << options.output << "'\n";
+		return 1;
+	}
+	std::cout << "Weights are written to " << options.output << "\n";
+	return 0;
+}